@@ -0,0 +1,31 @@
+; ADD/ADDC/SUBB/DA A/RLC heavy loop for ALU and flag benchmarks
+	LJMP START
+	ORG	100H
+
+START:
+	MOV R0, #30H
+	MOV R1, #00H
+	CLR C
+LOOP:
+	MOV A, R1
+	ADD A, #37H
+	DA A
+	MOV R1, A
+	ADDC A, @R0
+	SUBB A, #12H
+	MOV @R0, A
+	RLC A
+	XRL A, R1
+	MOV 31H, A
+	CJNE A, #55H, SKIP
+	INC R2
+SKIP:
+	MOV A, R3
+	ADD A, #01H
+	MOV R3, A
+	MOV A, R4
+	ADDC A, #00H
+	MOV R4, A
+	JNC LOOP
+	CPL C
+	SJMP LOOP
@@ -0,0 +1,51 @@
+; 32-bit ADDC/SUBB chains and a packed BCD counter, with the occasional
+; OV and P test - flag-heavy code for the PSW benchmarks
+	LJMP START
+	ORG	100H
+
+START:
+	MOV R0, #30H
+	MOV R1, #40H
+LOOP:
+	; 32-bit add: 30H..33H += 40H..43H
+	MOV A, 30H
+	ADD A, 40H
+	MOV 30H, A
+	MOV A, 31H
+	ADDC A, 41H
+	MOV 31H, A
+	MOV A, 32H
+	ADDC A, 42H
+	MOV 32H, A
+	MOV A, 33H
+	ADDC A, 43H
+	MOV 33H, A
+	; 32-bit subtract: 40H..43H -= 0DF9B5713H
+	CLR C
+	MOV A, 40H
+	SUBB A, #13H
+	MOV 40H, A
+	MOV A, 41H
+	SUBB A, #57H
+	MOV 41H, A
+	MOV A, 42H
+	SUBB A, #9BH
+	MOV 42H, A
+	MOV A, 43H
+	SUBB A, #0DFH
+	MOV 43H, A
+	JNB OV, NOOV
+	INC 38H
+NOOV:
+	; Packed BCD counter in 50H..51H
+	MOV A, 50H
+	ADD A, #01H
+	DA A
+	MOV 50H, A
+	MOV A, 51H
+	ADDC A, #00H
+	DA A
+	MOV 51H, A
+	JNB P, LOOP
+	INC 39H
+	SJMP LOOP
@@ -0,0 +1,30 @@
+; LCALL/RET, PUSH/POP and MOVC table lookups
+	LJMP START
+	ORG	100H
+
+START:
+	MOV SP, #60H
+LOOP:
+	LCALL SUB1
+	LCALL SUB2
+	SJMP LOOP
+
+SUB1:
+	MOV A, R5
+	ADD A, #03H
+	MOV R5, A
+	RET
+
+SUB2:
+	PUSH ACC
+	MOV DPTR, #TABLE
+	MOV A, R5
+	ANL A, #07H
+	MOVC A, @A+DPTR
+	MOV R6, A
+	POP ACC
+	RET
+
+	ORG	180H
+TABLE:
+	DB 1, 2, 3, 4, 5, 6, 7, 8
@@ -0,0 +1,17 @@
+; Nested DJNZ delay loops - the shape of most DSM-51 lab programs
+	LJMP START
+	ORG	100H
+
+START:
+	MOV R2, #00H
+LOOP:
+	MOV R7, #200
+OUTER:
+	MOV R6, #250
+INNER:
+	DJNZ R6, INNER
+	DJNZ R7, OUTER
+	INC R2
+	MOV A, R2
+	LCALL WRITE_HEX
+	SJMP LOOP
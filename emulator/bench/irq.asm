@@ -0,0 +1,33 @@
+; Timer 0 interrupts against a hot loop that re-enables them through @R0,
+; so the loop's own store moves the end of the run while it is looping
+	LJMP START
+	ORG	0BH
+	PUSH ACC
+	PUSH PSW
+	MOV A, R1
+	ADD A, R2
+	ADD A, B
+	MOV B, A
+	POP PSW
+	POP ACC
+	CLR EA
+	RETI
+	ORG	100H
+
+START:
+	MOV TMOD, #02H
+	MOV TH0, #9CH
+	MOV TL0, #9CH
+	SETB TR0
+	MOV A, #82H
+	MOV R0, #0A8H
+LOOP:
+	INC R1
+	MOV @R0, A
+	INC R2
+	INC R2
+	INC R2
+	INC R2
+	INC R2
+	DJNZ R7, LOOP
+	SJMP LOOP
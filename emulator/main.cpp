@@ -1,16 +1,41 @@
 #include <algorithm>
+#include <atomic>
+#include <bitset>
 #include <cctype>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <deque>
 #include <fstream>
-#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <string>
+#include <vector>
+
+// JIT backends: native builds on x86-64 Linux write machine code into
+// anonymous memory that is never writable and executable at once, the
+// Emscripten build generates one WebAssembly
+// module per block and instantiates it through the JS glue. Every other build
+// only interprets.
+#if !defined(BUILDING_FOR_WASM) && defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define INTEL8051_JIT_X86 1
+#else
+#define INTEL8051_JIT_X86 0
+#endif
+
+#if defined(BUILDING_FOR_WASM) && defined(__EMSCRIPTEN__)
+#include <emscripten.h>
+#define INTEL8051_JIT_WASM 1
+#else
+#define INTEL8051_JIT_WASM 0
+#endif
+
+#define INTEL8051_HAS_JIT (INTEL8051_JIT_X86 || INTEL8051_JIT_WASM)
 
 struct EmulatorState {
   uint64_t cycles;
@@ -26,14 +51,626 @@ struct EmulatorState {
   uint8_t p3;
 };
 
+// A write to P0-P3 that changed the port, as recorded by the port trace.
+// Hosts read these as 16-byte records: the cycle as a little-endian 64-bit
+// number, the port number, the new value and 6 bytes of padding.
+struct PortChange {
+  uint64_t cycle;
+  uint8_t port;
+  uint8_t value;
+};
+static_assert(sizeof(PortChange) == 16, "PortChange is read as 16 bytes");
+
+// Opcode dispatch engine, chosen at build time with -DINTEL8051_DISPATCH=<n>:
+//   0 - one switch statement over the opcode
+//   1 - 256-entry table of handler member pointers
+//   2 - direct-threaded computed goto (GCC/Clang only, otherwise the table)
+//   3 - cached basic blocks run as one unit, chained to their successors
+//       (default)
+// All engines run the same handlers and give identical results; run the
+// native binary with -b to compare their speed.
+#define INTEL8051_DISPATCH_SWITCH 0
+#define INTEL8051_DISPATCH_TABLE 1
+#define INTEL8051_DISPATCH_THREADED 2
+#define INTEL8051_DISPATCH_BLOCK 3
+
+#ifndef INTEL8051_DISPATCH
+#define INTEL8051_DISPATCH INTEL8051_DISPATCH_BLOCK
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define INTEL8051_HAS_THREADED_DISPATCH 1
+#else
+#define INTEL8051_HAS_THREADED_DISPATCH 0
+#endif
+
+enum class DispatchEngine { Switch, Table, Threaded, Block };
+
+// Native code for hot basic blocks, used by the block engine. Lockstep runs
+// every translated block a second time on the interpreter and reports any
+// difference in registers, internal RAM, PC or cycle count.
+enum class JitMode { Off, On, Lockstep };
+
+// Why the last run or step returned. Halted means the program jumped to
+// itself with nothing that could ever leave the loop; WaitingForInput, that
+// it waits in a system call or in such a loop for serial input to interrupt
+// it. Output only ends runs that asked for it, see Intel8051::runUntil().
+enum class StopReason {
+  CycleLimit,
+  Halted,
+  WaitingForInput,
+  Stopped,
+  Output,
+  Breakpoint,
+  Watchpoint,
+  StepComplete
+};
+
+// Accesses a watchpoint reacts to
+enum WatchAccess { WatchRead = 1, WatchWrite = 2 };
+
+#if INTEL8051_DISPATCH == INTEL8051_DISPATCH_BLOCK
+constexpr DispatchEngine defaultDispatchEngine = DispatchEngine::Block;
+#elif INTEL8051_DISPATCH == INTEL8051_DISPATCH_THREADED &&                     \
+    INTEL8051_HAS_THREADED_DISPATCH
+constexpr DispatchEngine defaultDispatchEngine = DispatchEngine::Threaded;
+#elif INTEL8051_DISPATCH != INTEL8051_DISPATCH_SWITCH
+constexpr DispatchEngine defaultDispatchEngine = DispatchEngine::Table;
+#else
+constexpr DispatchEngine defaultDispatchEngine = DispatchEngine::Switch;
+#endif
+
+// Opcode map: every opcode with the handler that implements it, its length
+// in bytes and its cost in machine cycles. Each dispatch engine and the
+// predecoder are generated from this one list so they cannot drift apart.
+#define INTEL8051_OPCODES(X)                                                   \
+  /* 0x0X */                                                                   \
+  X(0x00, op_NOP, 1, 1) X(0x01, op_AJMP, 2, 2) X(0x02, op_LJMP, 3, 2)          \
+  X(0x03, op_RR_A, 1, 1) X(0x04, op_INC_A, 1, 1) X(0x05, op_INC_direct, 2, 1)  \
+  X(0x06, op_INC_indirect, 1, 1) X(0x07, op_INC_indirect, 1, 1)                \
+  X(0x08, op_INC_Rn<0>, 1, 1) X(0x09, op_INC_Rn<1>, 1, 1)                      \
+  X(0x0A, op_INC_Rn<2>, 1, 1) X(0x0B, op_INC_Rn<3>, 1, 1)                      \
+  X(0x0C, op_INC_Rn<4>, 1, 1) X(0x0D, op_INC_Rn<5>, 1, 1)                      \
+  X(0x0E, op_INC_Rn<6>, 1, 1) X(0x0F, op_INC_Rn<7>, 1, 1)                      \
+  /* 0x1X */                                                                   \
+  X(0x10, op_JBC, 3, 2) X(0x11, op_CALL, 2, 2) X(0x12, op_CALL, 3, 2)          \
+  X(0x13, op_RRC_A, 1, 1) X(0x14, op_DEC_A, 1, 1)                              \
+  X(0x15, op_DEC_direct, 2, 1) X(0x16, op_DEC_indirect, 1, 1)                  \
+  X(0x17, op_DEC_indirect, 1, 1) X(0x18, op_DEC_Rn<0>, 1, 1)                   \
+  X(0x19, op_DEC_Rn<1>, 1, 1) X(0x1A, op_DEC_Rn<2>, 1, 1)                      \
+  X(0x1B, op_DEC_Rn<3>, 1, 1) X(0x1C, op_DEC_Rn<4>, 1, 1)                      \
+  X(0x1D, op_DEC_Rn<5>, 1, 1) X(0x1E, op_DEC_Rn<6>, 1, 1)                      \
+  X(0x1F, op_DEC_Rn<7>, 1, 1)                                                  \
+  /* 0x2X */                                                                   \
+  X(0x20, op_JB, 3, 2) X(0x21, op_AJMP, 2, 2) X(0x22, op_RET, 1, 2)            \
+  X(0x23, op_RL_A, 1, 1) X(0x24, op_ADD_imm, 2, 1)                             \
+  X(0x25, op_ADD_direct, 2, 1) X(0x26, op_ADD_indirect, 1, 1)                  \
+  X(0x27, op_ADD_indirect, 1, 1) X(0x28, op_ADD_Rn<0>, 1, 1)                   \
+  X(0x29, op_ADD_Rn<1>, 1, 1) X(0x2A, op_ADD_Rn<2>, 1, 1)                      \
+  X(0x2B, op_ADD_Rn<3>, 1, 1) X(0x2C, op_ADD_Rn<4>, 1, 1)                      \
+  X(0x2D, op_ADD_Rn<5>, 1, 1) X(0x2E, op_ADD_Rn<6>, 1, 1)                      \
+  X(0x2F, op_ADD_Rn<7>, 1, 1)                                                  \
+  /* 0x3X */                                                                   \
+  X(0x30, op_JNB, 3, 2) X(0x31, op_CALL, 2, 2) X(0x32, op_RETI, 1, 2)          \
+  X(0x33, op_RLC_A, 1, 1) X(0x34, op_ADDC_imm, 2, 1)                           \
+  X(0x35, op_ADDC_direct, 2, 1) X(0x36, op_ADDC_indirect, 1, 1)                \
+  X(0x37, op_ADDC_indirect, 1, 1) X(0x38, op_ADDC_Rn<0>, 1, 1)                 \
+  X(0x39, op_ADDC_Rn<1>, 1, 1) X(0x3A, op_ADDC_Rn<2>, 1, 1)                    \
+  X(0x3B, op_ADDC_Rn<3>, 1, 1) X(0x3C, op_ADDC_Rn<4>, 1, 1)                    \
+  X(0x3D, op_ADDC_Rn<5>, 1, 1) X(0x3E, op_ADDC_Rn<6>, 1, 1)                    \
+  X(0x3F, op_ADDC_Rn<7>, 1, 1)                                                 \
+  /* 0x4X */                                                                   \
+  X(0x40, op_JC, 2, 2) X(0x41, op_AJMP, 2, 2) X(0x42, op_ORL_direct_A, 2, 1)   \
+  X(0x43, op_ORL_direct_imm, 3, 2) X(0x44, op_ORL_A_imm, 2, 1)                 \
+  X(0x45, op_ORL_A_direct, 2, 1) X(0x46, op_ORL_A_indirect, 1, 1)              \
+  X(0x47, op_ORL_A_indirect, 1, 1) X(0x48, op_ORL_A_Rn<0>, 1, 1)               \
+  X(0x49, op_ORL_A_Rn<1>, 1, 1) X(0x4A, op_ORL_A_Rn<2>, 1, 1)                  \
+  X(0x4B, op_ORL_A_Rn<3>, 1, 1) X(0x4C, op_ORL_A_Rn<4>, 1, 1)                  \
+  X(0x4D, op_ORL_A_Rn<5>, 1, 1) X(0x4E, op_ORL_A_Rn<6>, 1, 1)                  \
+  X(0x4F, op_ORL_A_Rn<7>, 1, 1)                                                \
+  /* 0x5X */                                                                   \
+  X(0x50, op_JNC, 2, 2) X(0x51, op_CALL, 2, 2) X(0x52, op_ANL_direct_A, 2, 1)  \
+  X(0x53, op_ANL_direct_imm, 3, 2) X(0x54, op_ANL_A_imm, 2, 1)                 \
+  X(0x55, op_ANL_A_direct, 2, 1) X(0x56, op_ANL_A_indirect, 1, 1)              \
+  X(0x57, op_ANL_A_indirect, 1, 1) X(0x58, op_ANL_A_Rn<0>, 1, 1)               \
+  X(0x59, op_ANL_A_Rn<1>, 1, 1) X(0x5A, op_ANL_A_Rn<2>, 1, 1)                  \
+  X(0x5B, op_ANL_A_Rn<3>, 1, 1) X(0x5C, op_ANL_A_Rn<4>, 1, 1)                  \
+  X(0x5D, op_ANL_A_Rn<5>, 1, 1) X(0x5E, op_ANL_A_Rn<6>, 1, 1)                  \
+  X(0x5F, op_ANL_A_Rn<7>, 1, 1)                                                \
+  /* 0x6X */                                                                   \
+  X(0x60, op_JZ, 2, 2) X(0x61, op_AJMP, 2, 2) X(0x62, op_XRL_direct_A, 2, 1)   \
+  X(0x63, op_XRL_direct_imm, 3, 2) X(0x64, op_XRL_A_imm, 2, 1)                 \
+  X(0x65, op_XRL_A_direct, 2, 1) X(0x66, op_XRL_A_indirect, 1, 1)              \
+  X(0x67, op_XRL_A_indirect, 1, 1) X(0x68, op_XRL_A_Rn<0>, 1, 1)               \
+  X(0x69, op_XRL_A_Rn<1>, 1, 1) X(0x6A, op_XRL_A_Rn<2>, 1, 1)                  \
+  X(0x6B, op_XRL_A_Rn<3>, 1, 1) X(0x6C, op_XRL_A_Rn<4>, 1, 1)                  \
+  X(0x6D, op_XRL_A_Rn<5>, 1, 1) X(0x6E, op_XRL_A_Rn<6>, 1, 1)                  \
+  X(0x6F, op_XRL_A_Rn<7>, 1, 1)                                                \
+  /* 0x7X */                                                                   \
+  X(0x70, op_JNZ, 2, 2) X(0x71, op_CALL, 2, 2) X(0x72, op_ORL_C_bit, 2, 2)     \
+  X(0x73, op_JMP_A_DPTR, 1, 2) X(0x74, op_MOV_A_imm, 2, 1)                     \
+  X(0x75, op_MOV_direct_imm, 3, 2) X(0x76, op_MOV_indirect_imm, 2, 1)          \
+  X(0x77, op_MOV_indirect_imm, 2, 1) X(0x78, op_MOV_Rn_imm<0>, 2, 1)           \
+  X(0x79, op_MOV_Rn_imm<1>, 2, 1) X(0x7A, op_MOV_Rn_imm<2>, 2, 1)              \
+  X(0x7B, op_MOV_Rn_imm<3>, 2, 1) X(0x7C, op_MOV_Rn_imm<4>, 2, 1)              \
+  X(0x7D, op_MOV_Rn_imm<5>, 2, 1) X(0x7E, op_MOV_Rn_imm<6>, 2, 1)              \
+  X(0x7F, op_MOV_Rn_imm<7>, 2, 1)                                              \
+  /* 0x8X */                                                                   \
+  X(0x80, op_SJMP, 2, 2) X(0x81, op_AJMP, 2, 2) X(0x82, op_ANL_C_bit, 2, 2)    \
+  X(0x83, op_MOVC_A_PC, 1, 2) X(0x84, op_DIV_AB, 1, 4)                         \
+  X(0x85, op_MOV_direct_direct, 3, 2) X(0x86, op_MOV_direct_indirect, 2, 2)    \
+  X(0x87, op_MOV_direct_indirect, 2, 2) X(0x88, op_MOV_direct_Rn<0>, 2, 2)     \
+  X(0x89, op_MOV_direct_Rn<1>, 2, 2) X(0x8A, op_MOV_direct_Rn<2>, 2, 2)        \
+  X(0x8B, op_MOV_direct_Rn<3>, 2, 2) X(0x8C, op_MOV_direct_Rn<4>, 2, 2)        \
+  X(0x8D, op_MOV_direct_Rn<5>, 2, 2) X(0x8E, op_MOV_direct_Rn<6>, 2, 2)        \
+  X(0x8F, op_MOV_direct_Rn<7>, 2, 2)                                           \
+  /* 0x9X */                                                                   \
+  X(0x90, op_MOV_DPTR_imm, 3, 2) X(0x91, op_CALL, 2, 2)                        \
+  X(0x92, op_MOV_bit_C, 2, 2) X(0x93, op_MOVC_A_DPTR, 1, 2)                    \
+  X(0x94, op_SUBB_imm, 2, 1) X(0x95, op_SUBB_direct, 2, 1)                     \
+  X(0x96, op_SUBB_indirect, 1, 1) X(0x97, op_SUBB_indirect, 1, 1)              \
+  X(0x98, op_SUBB_Rn<0>, 1, 1) X(0x99, op_SUBB_Rn<1>, 1, 1)                    \
+  X(0x9A, op_SUBB_Rn<2>, 1, 1) X(0x9B, op_SUBB_Rn<3>, 1, 1)                    \
+  X(0x9C, op_SUBB_Rn<4>, 1, 1) X(0x9D, op_SUBB_Rn<5>, 1, 1)                    \
+  X(0x9E, op_SUBB_Rn<6>, 1, 1) X(0x9F, op_SUBB_Rn<7>, 1, 1)                    \
+  /* 0xAX */                                                                   \
+  X(0xA0, op_ORL_C_nbit, 2, 2) X(0xA1, op_AJMP, 2, 2)                          \
+  X(0xA2, op_MOV_C_bit, 2, 1) X(0xA3, op_INC_DPTR, 1, 2)                       \
+  X(0xA4, op_MUL_AB, 1, 4) X(0xA5, op_reserved, 1, 1)                          \
+  X(0xA6, op_MOV_indirect_direct, 2, 2) X(0xA7, op_MOV_indirect_direct, 2, 2)  \
+  X(0xA8, op_MOV_Rn_direct<0>, 2, 2) X(0xA9, op_MOV_Rn_direct<1>, 2, 2)        \
+  X(0xAA, op_MOV_Rn_direct<2>, 2, 2) X(0xAB, op_MOV_Rn_direct<3>, 2, 2)        \
+  X(0xAC, op_MOV_Rn_direct<4>, 2, 2) X(0xAD, op_MOV_Rn_direct<5>, 2, 2)        \
+  X(0xAE, op_MOV_Rn_direct<6>, 2, 2) X(0xAF, op_MOV_Rn_direct<7>, 2, 2)        \
+  /* 0xBX */                                                                   \
+  X(0xB0, op_ANL_C_nbit, 2, 2) X(0xB1, op_CALL, 2, 2)                          \
+  X(0xB2, op_CPL_bit, 2, 1) X(0xB3, op_CPL_C, 1, 1)                            \
+  X(0xB4, op_CJNE_A_imm, 3, 2) X(0xB5, op_CJNE_A_direct, 3, 2)                 \
+  X(0xB6, op_CJNE_indirect_imm, 3, 2) X(0xB7, op_CJNE_indirect_imm, 3, 2)      \
+  X(0xB8, op_CJNE_Rn_imm<0>, 3, 2) X(0xB9, op_CJNE_Rn_imm<1>, 3, 2)            \
+  X(0xBA, op_CJNE_Rn_imm<2>, 3, 2) X(0xBB, op_CJNE_Rn_imm<3>, 3, 2)            \
+  X(0xBC, op_CJNE_Rn_imm<4>, 3, 2) X(0xBD, op_CJNE_Rn_imm<5>, 3, 2)            \
+  X(0xBE, op_CJNE_Rn_imm<6>, 3, 2) X(0xBF, op_CJNE_Rn_imm<7>, 3, 2)            \
+  /* 0xCX */                                                                   \
+  X(0xC0, op_PUSH, 2, 2) X(0xC1, op_AJMP, 2, 2) X(0xC2, op_CLR_bit, 2, 1)      \
+  X(0xC3, op_CLR_C, 1, 1) X(0xC4, op_SWAP_A, 1, 1)                             \
+  X(0xC5, op_XCH_A_direct, 2, 1) X(0xC6, op_XCH_A_indirect, 1, 1)              \
+  X(0xC7, op_XCH_A_indirect, 1, 1) X(0xC8, op_XCH_A_Rn<0>, 1, 1)               \
+  X(0xC9, op_XCH_A_Rn<1>, 1, 1) X(0xCA, op_XCH_A_Rn<2>, 1, 1)                  \
+  X(0xCB, op_XCH_A_Rn<3>, 1, 1) X(0xCC, op_XCH_A_Rn<4>, 1, 1)                  \
+  X(0xCD, op_XCH_A_Rn<5>, 1, 1) X(0xCE, op_XCH_A_Rn<6>, 1, 1)                  \
+  X(0xCF, op_XCH_A_Rn<7>, 1, 1)                                                \
+  /* 0xDX */                                                                   \
+  X(0xD0, op_POP, 2, 2) X(0xD1, op_CALL, 2, 2) X(0xD2, op_SETB_bit, 2, 1)      \
+  X(0xD3, op_SETB_C, 1, 1) X(0xD4, op_DA_A, 1, 1)                              \
+  X(0xD5, op_DJNZ_direct, 3, 2) X(0xD6, op_XCHD_A_indirect, 1, 1)              \
+  X(0xD7, op_XCHD_A_indirect, 1, 1) X(0xD8, op_DJNZ_Rn<0>, 2, 2)               \
+  X(0xD9, op_DJNZ_Rn<1>, 2, 2) X(0xDA, op_DJNZ_Rn<2>, 2, 2)                    \
+  X(0xDB, op_DJNZ_Rn<3>, 2, 2) X(0xDC, op_DJNZ_Rn<4>, 2, 2)                    \
+  X(0xDD, op_DJNZ_Rn<5>, 2, 2) X(0xDE, op_DJNZ_Rn<6>, 2, 2)                    \
+  X(0xDF, op_DJNZ_Rn<7>, 2, 2)                                                 \
+  /* 0xEX */                                                                   \
+  X(0xE0, op_MOVX_A_DPTR, 1, 2) X(0xE1, op_AJMP, 2, 2)                         \
+  X(0xE2, op_MOVX_A_indirect, 1, 2) X(0xE3, op_MOVX_A_indirect, 1, 2)          \
+  X(0xE4, op_CLR_A, 1, 1) X(0xE5, op_MOV_A_direct, 2, 1)                       \
+  X(0xE6, op_MOV_A_indirect, 1, 1) X(0xE7, op_MOV_A_indirect, 1, 1)            \
+  X(0xE8, op_MOV_A_Rn<0>, 1, 1) X(0xE9, op_MOV_A_Rn<1>, 1, 1)                  \
+  X(0xEA, op_MOV_A_Rn<2>, 1, 1) X(0xEB, op_MOV_A_Rn<3>, 1, 1)                  \
+  X(0xEC, op_MOV_A_Rn<4>, 1, 1) X(0xED, op_MOV_A_Rn<5>, 1, 1)                  \
+  X(0xEE, op_MOV_A_Rn<6>, 1, 1) X(0xEF, op_MOV_A_Rn<7>, 1, 1)                  \
+  /* 0xFX */                                                                   \
+  X(0xF0, op_MOVX_DPTR_A, 1, 2) X(0xF1, op_CALL, 2, 2)                         \
+  X(0xF2, op_MOVX_indirect_A, 1, 2) X(0xF3, op_MOVX_indirect_A, 1, 2)          \
+  X(0xF4, op_CPL_A, 1, 1) X(0xF5, op_MOV_direct_A, 2, 1)                       \
+  X(0xF6, op_MOV_indirect_A, 1, 1) X(0xF7, op_MOV_indirect_A, 1, 1)            \
+  X(0xF8, op_MOV_Rn_A<0>, 1, 1) X(0xF9, op_MOV_Rn_A<1>, 1, 1)                  \
+  X(0xFA, op_MOV_Rn_A<2>, 1, 1) X(0xFB, op_MOV_Rn_A<3>, 1, 1)                  \
+  X(0xFC, op_MOV_Rn_A<4>, 1, 1) X(0xFD, op_MOV_Rn_A<5>, 1, 1)                  \
+  X(0xFE, op_MOV_Rn_A<6>, 1, 1) X(0xFF, op_MOV_Rn_A<7>, 1, 1)
+
+// F(n) for n = start .. start + 4^k - 1, to generate lookup tables whose
+// entries are constant expressions
+#define INTEL8051_REPEAT4(F, n) F(n) F(n + 1) F(n + 2) F(n + 3)
+#define INTEL8051_REPEAT16(F, n)                                               \
+  INTEL8051_REPEAT4(F, n) INTEL8051_REPEAT4(F, n + 4)                          \
+  INTEL8051_REPEAT4(F, n + 8) INTEL8051_REPEAT4(F, n + 12)
+#define INTEL8051_REPEAT64(F, n)                                               \
+  INTEL8051_REPEAT16(F, n) INTEL8051_REPEAT16(F, n + 16)                       \
+  INTEL8051_REPEAT16(F, n + 32) INTEL8051_REPEAT16(F, n + 48)
+#define INTEL8051_REPEAT256(F, n)                                              \
+  INTEL8051_REPEAT64(F, n) INTEL8051_REPEAT64(F, n + 64)                       \
+  INTEL8051_REPEAT64(F, n + 128) INTEL8051_REPEAT64(F, n + 192)
+#define INTEL8051_REPEAT1024(F, n)                                             \
+  INTEL8051_REPEAT256(F, n) INTEL8051_REPEAT256(F, n + 256)                    \
+  INTEL8051_REPEAT256(F, n + 512) INTEL8051_REPEAT256(F, n + 768)
+
+// DSM-51 monitor routines run natively instead of being called, in address
+// order from 0x8100 in steps of two
+#define INTEL8051_SYSTEM_CALLS(X)                                              \
+  X(WRITE_TEXT) X(WRITE_DATA) X(WRITE_HEX) X(WRITE_INSTR) X(LCD_INIT)          \
+  X(LCD_OFF) X(LCD_CLR) X(DELAY_US) X(DELAY_MS) X(DELAY_100MS) X(WAIT_ENTER)   \
+  X(WAIT_ENTER_NW) X(TEST_ENTER) X(WAIT_ENT_ESC) X(WAIT_KEY) X(GET_NUM)        \
+  X(BCD_HEX) X(HEX_BCD) X(MUL_2_2) X(MUL_3_1) X(DIV_2_1) X(DIV_4_2)
+
+#if INTEL8051_JIT_X86
+// Minimal x86-64 machine code writer for the JIT. Translated code keeps the
+// Intel8051 pointer in rbx, so memory operands are rbx + disp32.
+class X86Emitter {
+public:
+  enum Register { AL = 0, CL = 1, DL = 2 };
+
+  std::vector<uint8_t> code;
+
+  void emit(std::initializer_list<uint8_t> bytes) {
+    code.insert(code.end(), bytes);
+  }
+
+  void imm8(uint8_t value) { code.push_back(value); }
+
+  void imm16(uint16_t value) {
+    imm8(value & 0xFF);
+    imm8(value >> 8);
+  }
+
+  void imm32(uint32_t value) {
+    imm16(value & 0xFFFF);
+    imm16(value >> 16);
+  }
+
+  void imm64(uint64_t value) {
+    imm32(static_cast<uint32_t>(value));
+    imm32(static_cast<uint32_t>(value >> 32));
+  }
+
+  // opcode with a [rbx + disp32] operand; reg is a register or /digit
+  void mem(std::initializer_list<uint8_t> opcode, uint8_t reg, int32_t disp) {
+    emit(opcode);
+    imm8(0x83 | (reg << 3));
+    imm32(disp);
+  }
+
+  // opcode with a [rbx + rax + disp32] operand, used for Rn with the
+  // register bank base in rax
+  void bankMem(std::initializer_list<uint8_t> opcode, uint8_t reg,
+               int32_t disp) {
+    emit(opcode);
+    imm8(0x84 | (reg << 3));
+    imm8(0x03);
+    imm32(disp);
+  }
+
+  size_t position() const { return code.size(); }
+
+  // Emits a jump with a 32-bit displacement to be bound later
+  size_t jump(std::initializer_list<uint8_t> opcode) {
+    emit(opcode);
+    imm32(0);
+    return code.size();
+  }
+
+  void bind(size_t jumpEnd, size_t target) {
+    int32_t rel = static_cast<int32_t>(target - jumpEnd);
+    memcpy(&code[jumpEnd - 4], &rel, sizeof(rel));
+  }
+};
+
+// Executable memory for translated blocks. Code is only ever appended; the
+// whole buffer is recycled when the program changes. Pages are mapped
+// read/write, and the ones an append touches are switched to read/execute
+// as soon as the code is in, so no page is writable and executable at once.
+class JitCodeBuffer {
+public:
+  JitCodeBuffer() : base(nullptr), used(0) {}
+  JitCodeBuffer(const JitCodeBuffer &) = delete;
+  JitCodeBuffer &operator=(const JitCodeBuffer &) = delete;
+
+  ~JitCodeBuffer() {
+    if (base) {
+      munmap(base, capacity);
+    }
+  }
+
+  // Copies code in and returns where it can be called, or nullptr when the
+  // buffer is full or executable memory is not available
+  void *append(const std::vector<uint8_t> &code) {
+    if (!base) {
+      void *memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (memory == MAP_FAILED) {
+        return nullptr;
+      }
+      base = static_cast<uint8_t *>(memory);
+    }
+    size_t start = (used + 15) & ~static_cast<size_t>(15);
+    if (start + code.size() > capacity) {
+      return nullptr;
+    }
+    // The first page may already hold earlier blocks, which are not running
+    // while a block is being translated
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t first = start & ~(page - 1);
+    size_t length = ((start + code.size() + page - 1) & ~(page - 1)) - first;
+    if (mprotect(base + first, length, PROT_READ | PROT_WRITE) != 0) {
+      return nullptr;
+    }
+    memcpy(base + start, code.data(), code.size());
+    if (mprotect(base + first, length, PROT_READ | PROT_EXEC) != 0) {
+      return nullptr;
+    }
+    used = start + code.size();
+    return base + start;
+  }
+
+  void clear() { used = 0; }
+
+private:
+  static const size_t capacity = 4 << 20;
+  uint8_t *base;
+  size_t used;
+};
+#endif
+
+#if INTEL8051_JIT_WASM
+// Builds the WebAssembly module for one translated block. The module imports
+// the emulator's linear memory as e.m and the interpreter fallback as e.i,
+// and exports f, which takes the Intel8051 * only. Local 0 is that
+// parameter, 1-3 are i32 scratch and 4 is i64 scratch.
+class WasmEmitter {
+public:
+  enum Local { Cpu = 0, T = 1, U = 2, P = 3, C = 4 };
+
+  std::vector<uint8_t> code; // Function body
+
+  void op(uint8_t opcode) { code.push_back(opcode); }
+
+  void u32(uint32_t value) {
+    do {
+      uint8_t byte = value & 0x7F;
+      value >>= 7;
+      code.push_back(value ? byte | 0x80 : byte);
+    } while (value);
+  }
+
+  void s64(int64_t value) {
+    bool more = true;
+    while (more) {
+      uint8_t byte = value & 0x7F;
+      value >>= 7;
+      bool signBit = byte & 0x40;
+      more = !((value == 0 && !signBit) || (value == -1 && signBit));
+      code.push_back(more ? byte | 0x80 : byte);
+    }
+  }
+
+  void i32Const(int32_t value) {
+    op(0x41);
+    s64(value);
+  }
+
+  void i64Const(int64_t value) {
+    op(0x42);
+    s64(value);
+  }
+
+  void localGet(Local local) {
+    op(0x20);
+    u32(local);
+  }
+
+  void localSet(Local local) {
+    op(0x21);
+    u32(local);
+  }
+
+  void localTee(Local local) {
+    op(0x22);
+    u32(local);
+  }
+
+  // Memory accesses relative to the address on the stack
+  void load8(uint32_t offset) { memory(0x2D, 0, offset); }
+  void store8(uint32_t offset) { memory(0x3A, 0, offset); }
+  void store16(uint32_t offset) { memory(0x3B, 1, offset); }
+  void load64(uint32_t offset) { memory(0x29, 3, offset); }
+  void store64(uint32_t offset) { memory(0x37, 3, offset); }
+
+  // Wraps the function body into a complete module
+  std::vector<uint8_t> module() const {
+    std::vector<uint8_t> out = {0x00, 0x61, 0x73, 0x6D, 0x01, 0x00, 0x00, 0x00};
+    // Types (i32) -> () for the block and (i32, i64) -> i32 for e.i
+    section(out, 1,
+            {0x02, 0x60, 0x01, 0x7F, 0x00, 0x60, 0x02, 0x7F, 0x7E, 0x01, 0x7F});
+    section(out, 2,
+            {0x02, 0x01, 'e', 0x01, 'm', 0x02, 0x00, 0x00, // memory e.m
+             0x01, 'e', 0x01, 'i', 0x00, 0x01});           // func e.i
+    section(out, 3, {0x01, 0x00});
+    section(out, 7, {0x01, 0x01, 'f', 0x00, 0x01});
+
+    WasmEmitter body;
+    body.code = {0x02, 0x03, 0x7F, 0x01, 0x7E}; // Locals: 3 x i32, 1 x i64
+    body.code.insert(body.code.end(), code.begin(), code.end());
+    body.op(0x0B);
+    WasmEmitter entries;
+    entries.u32(1);
+    entries.u32(static_cast<uint32_t>(body.code.size()));
+    entries.code.insert(entries.code.end(), body.code.begin(),
+                        body.code.end());
+    section(out, 10, entries.code);
+    return out;
+  }
+
+private:
+  void memory(uint8_t opcode, uint32_t align, uint32_t offset) {
+    op(opcode);
+    u32(align);
+    u32(offset);
+  }
+
+  static void section(std::vector<uint8_t> &out, uint8_t id,
+                      const std::vector<uint8_t> &contents) {
+    WasmEmitter header;
+    header.op(id);
+    header.u32(static_cast<uint32_t>(contents.size()));
+    out.insert(out.end(), header.code.begin(), header.code.end());
+    out.insert(out.end(), contents.begin(), contents.end());
+  }
+};
+
+class Intel8051;
+
+// Compiles and instantiates a block module and puts its function into the
+// indirect function table, so that C++ can call the returned index as a
+// function pointer. Returns 0 (a null pointer) when the engine refuses, for
+// instance browsers that limit synchronous compilation on the main thread.
+// Each emulator's slots are listed in Module.jitTables, and the slots that
+// jitReleaseWasm() frees are reused by any emulator.
+EM_JS(int, jitInstantiateWasm,
+      (Intel8051 * cpu, const uint8_t *code, size_t size, int interpret), {
+        try {
+          var module = new WebAssembly.Module(HEAPU8.slice(code, code + size));
+          var instance = new WebAssembly.Instance(
+              module, {e : {m : wasmMemory, i : wasmTable.get(interpret)}});
+          var tables = Module.jitTables || (Module.jitTables = {});
+          var free = Module.jitFreeSlots || (Module.jitFreeSlots = []);
+          var used = tables[cpu] || (tables[cpu] = []);
+          var index = free.length ? free.pop() : wasmTable.grow(1);
+          wasmTable.set(index, instance.exports.f);
+          used.push(index);
+          return index;
+        } catch (e) {
+          return 0;
+        }
+      });
+
+// Frees all slots of an emulator and forgets it, so that a destroyed
+// emulator leaves nothing behind in Module.jitTables
+EM_JS(void, jitReleaseWasm, (Intel8051 * cpu), {
+  var used = Module.jitTables && Module.jitTables[cpu];
+  if (used) {
+    used.forEach(function(index) { wasmTable.set(index, null); });
+    Module.jitFreeSlots = Module.jitFreeSlots.concat(used);
+    delete Module.jitTables[cpu];
+  }
+});
+#endif
+
+// Byte queue between the emulator and the host with one producer and one
+// consumer. The producer only moves tail and the consumer only moves head,
+// so either side may run on another thread without a lock.
+class ByteRing {
+public:
+  ByteRing() : head(0), tail(0) {}
+
+  // Appends as much of data as fits and returns how many bytes that was
+  size_t push(const uint8_t *data, size_t length) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    size_t count = std::min(length, static_cast<size_t>(capacity - (t - h)));
+    uint32_t at = t % capacity;
+    size_t first = std::min(count, static_cast<size_t>(capacity - at));
+    memcpy(buffer + at, data, first);
+    memcpy(buffer, data + first, count - first);
+    tail.store(t + static_cast<uint32_t>(count), std::memory_order_release);
+    return count;
+  }
+
+  // Removes up to maxLen bytes into data and returns how many there were
+  size_t pop(uint8_t *data, size_t maxLen) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t t = tail.load(std::memory_order_acquire);
+    size_t count = std::min(maxLen, static_cast<size_t>(t - h));
+    uint32_t at = h % capacity;
+    size_t first = std::min(count, static_cast<size_t>(capacity - at));
+    memcpy(data, buffer + at, first);
+    memcpy(data + first, buffer, count - first);
+    head.store(h + static_cast<uint32_t>(count), std::memory_order_release);
+    return count;
+  }
+
+  bool empty() const {
+    return head.load(std::memory_order_relaxed) ==
+           tail.load(std::memory_order_acquire);
+  }
+
+  // Drops everything queued; a consumer operation
+  void clear() {
+    head.store(tail.load(std::memory_order_acquire),
+               std::memory_order_release);
+  }
+
+private:
+  static const uint32_t capacity = 1 << 16; // Divides 2^32, so t - h wraps
+  std::atomic<uint32_t> head;
+  std::atomic<uint32_t> tail;
+  uint8_t buffer[capacity];
+};
+
 class Intel8051 {
 private:
+  friend struct StaticProgram; // Generated by writeStaticProgram()
+
   // Memory spaces
   uint8_t programMemory[65536]; // 64KB program memory (ROM)
   uint8_t dataMemory[256];      // 256 bytes internal RAM
   uint8_t externalRAM[65536];   // 64KB external RAM
 
-  // CPU Registers
+  struct DecodedInstruction;
+  typedef void (Intel8051::*OpHandler)(const DecodedInstruction &insn);
+
+  // One predecoded instruction, cached per program memory address
+  struct DecodedInstruction {
+    OpHandler handler;
+    uint16_t target; // Jump/call destination, precomputed
+    uint8_t opcode;
+    uint8_t operand1;
+    uint8_t operand2;
+    uint8_t length;
+    uint8_t cycles;
+  };
+
+  static const OpHandler opcodeTable[256];
+  static const uint8_t opcodeLengths[256];
+  static const uint8_t opcodeCycles[256];
+  static const char *const opcodeHandlerNames[256];
+
+  // Predecoded program memory, see refreshDecodeCache()
+  std::vector<DecodedInstruction> decodeCache;
+  std::vector<uint8_t> decodedRom; // ROM bytes the cache was decoded from
+  bool decodeCacheStale;
+
+#if INTEL8051_HAS_JIT
+  typedef void (*JitFunction)(Intel8051 *cpu);
+#endif
+
+  // A straight run of instructions that ends at a jump, call or return and
+  // is executed as one unit, see runBlocks()
+  struct BasicBlock {
+    uint32_t first;  // Index of the first instruction in blockCode
+    uint32_t count;  // Number of instructions
+    uint32_t cycles; // Machine cycles of all instructions together
+    uint16_t start;
+    uint16_t fallThrough; // Address after the last instruction
+    uint16_t taken;       // Branch target of the last instruction
+    // Chained successor blocks, -1 until first used
+    int32_t nextFallThrough;
+    int32_t nextTaken;
+    bool writesIndirect; // Has @Ri stores, which may reach the SFRs
+#if INTEL8051_HAS_JIT
+    uint32_t executions; // Interpreted runs so far, see jitThreshold
+    JitFunction jit;     // Translated code, or nullptr
+    bool sideEffects;    // Calls, MOVX; not replayed by lockstep
+    bool loops;          // Translated code loops on itself, see compileBlock()
+#endif
+  };
+
+  static const uint32_t maxBlockLength = 64;
+
+  std::vector<BasicBlock> blocks;
+  std::vector<DecodedInstruction> blockCode; // Instructions of all blocks
+  std::vector<int32_t> blockAt; // Block starting at each address, or -1
+
+  // CPU Registers. These are the only copy of the SFRs at 0xE0, 0xF0, 0x82,
+  // 0x83, 0x81 and 0xD0; their bytes in dataMemory are not used for them.
   uint8_t A;     // Accumulator
   uint8_t B;     // B register
   uint16_t DPTR; // Data Pointer (DPH:DPL)
@@ -41,6 +678,10 @@ private:
   uint16_t PC;   // Program Counter
   uint8_t PSW;   // Program Status Word
 
+  // Address of R0 in the selected bank, PSW & 0x18. Only PSW writes can
+  // switch banks, so writePSW() keeps it up to date.
+  uint8_t registerBankBase;
+
   // Special Function Registers (SFRs) - mapped to dataMemory[0x80-0xFF]
   uint8_t &P0;   // Port 0
   uint8_t &P1;   // Port 1
@@ -58,8 +699,143 @@ private:
   uint8_t &SBUF; // Serial Buffer
   uint8_t &PCON; // Power Control
 
+  // Direct accesses to 0x80-0xFF go through these tables, indexed by
+  // address - 0x80. A null entry means the SFR is plain storage in
+  // dataMemory; the CPU registers above and peripherals install hooks with
+  // attachSfr(). Read hooks must not have side effects, readMemoryByte()
+  // uses them to show the SFRs.
+  typedef uint8_t (Intel8051::*SfrRead)(uint8_t addr) const;
+  typedef void (Intel8051::*SfrWrite)(uint8_t addr, uint8_t value);
+  SfrRead sfrRead[128];
+  SfrWrite sfrWrite[128];
+
+  // MOVX accesses go through these tables, one entry per 256-byte page of
+  // the external address space. A null entry means the page is plain memory
+  // in externalRAM; memory-mapped devices install handlers with
+  // attachXram(). Device reads may have side effects, so readMemoryByte()
+  // shows the memory behind device pages instead.
+  typedef uint8_t (Intel8051::*XramRead)(uint16_t addr);
+  typedef void (Intel8051::*XramWrite)(uint16_t addr, uint8_t value);
+  XramRead xramRead[256];
+  XramWrite xramWrite[256];
+
+  // Peripherals are not ticked per instruction either. Each keeps its state
+  // as of the last time it caught up with cycleCount, catches up when one of
+  // its SFRs is accessed, and owns one slot of eventCycle for the next cycle
+  // it has to act at on its own, UINT64_MAX when there is none. nextEvent is
+  // the earliest of them; the run loops stop at endCycle, which is kept at
+  // min(runEnd, nextEvent), and continueRun() calls the handlers that are
+  // due. Events due at the same cycle run in the order of EventSource, so
+  // InterruptEvent comes last and sees the flags the others have set.
+  enum EventSource {
+    TimerEvent,
+    SerialEvent,
+    InterruptEvent,
+    eventSourceCount
+  };
+  typedef void (Intel8051::*EventHandler)();
+  EventHandler eventHandler[eventSourceCount];
+  uint64_t eventCycle[eventSourceCount];
+  uint64_t nextEvent;
+
+  // Timers 0 and 1: TL0/TH0/TL1/TH1 and the TF bits of TCON hold their
+  // values as of timerBase; the read hooks work out the current values from
+  // the cycles since, and writes that change how the timers count bring them
+  // up to date first with syncTimers(). timerOverflow is the cycle each
+  // counter overflows next, so checking for an overflow is a single
+  // comparison. TimerEvent is only scheduled for overflows something waits
+  // for, such as an enabled timer interrupt.
+  enum TimerCounter { Timer0, Timer1, Timer0High, timerCounterCount };
+  uint64_t timerBase;
+  uint64_t timerOverflow[timerCounterCount]; // UINT64_MAX when not counting
+
+  // Serial port. A write to SBUF hands the byte to serialOutput right away
+  // and sets TI once the frame has been shifted out; SBUF in dataMemory is
+  // the receive buffer. serialTxLeft and serialRxLeft are what is left of
+  // the frames in flight as of timerBase, 0 when idle, in baud clocks:
+  // Timer 1 overflows in modes 1 and 3, machine cycles in modes 0 and 2. A
+  // byte is only taken from serialInput while REN is set and RI is clear,
+  // so the host can push faster than the program reads without overruns.
+  ByteRing serialInput;
+  ByteRing serialOutput;
+  uint32_t serialTxLeft;
+  uint32_t serialRxLeft;
+  uint8_t serialRxByte; // Byte being received
+
+  // HD44780 character LCD, driven by the LCD system calls or through MOVX
+  // at 0xFF80-0xFF83. lcdDdram is indexed by DDRAM address; the two lines
+  // hold 40 characters each from 0x00 and 0x40. lcdScreen is the visible
+  // 2x16 window, rebuilt only when something that shows changes: each
+  // change bumps lcdGeneration and sets the line's bit in lcdDirty, which
+  // the host clears when it reads the lines back.
+  uint8_t lcdDdram[0x80];
+  uint8_t lcdCgram[0x40];
+  uint8_t lcdAddress;    // Address counter
+  bool lcdCgramAccess;   // Data goes to CGRAM instead of DDRAM
+  uint8_t lcdEntryMode;  // I/D and S
+  uint8_t lcdControl;    // D, C and B
+  uint8_t lcdShift;      // First DDRAM column shown, 0-39
+  uint64_t lcdBusyUntil; // BF reads 1 before this cycle
+  uint8_t lcdScreen[2][16];
+  uint32_t lcdGeneration;
+  uint8_t lcdDirty;
+
+  // Multiplexed 7-segment display: MOVX to 0xFF30 selects digits, one bit
+  // each, 0xFF38 sets the segments of the selected ones, bit 0 for a to bit
+  // 7 for the point, and P1.6 low turns the display on. Programs light one
+  // digit at a time, faster than the eye follows, so what is lit is folded
+  // into frames of displayWindow cycles instead: displayLit is how long each
+  // segment has been lit in the current frame as of displayBase, and the
+  // segments lit for 1/32 of the frame or more show in it. A frame that ends
+  // looking different from displayFrame replaces it and bumps
+  // displayGeneration.
+  static const int displayDigits = 6;
+  uint8_t displaySelect;   // Digits selected, bit n for digit n
+  uint8_t displaySegments; // Segments driven on the selected digits
+  uint32_t displayWindow;  // Frame length in cycles
+  uint64_t displayStart;   // Cycle the current frame started at
+  uint64_t displayBase;
+  uint32_t displayLit[displayDigits][8];
+  uint8_t displayFrame[displayDigits];
+  uint32_t displayGeneration;
+
+  // 4x4 matrix keypad, read through MOVX at 0xFF21 for keys 0-7 and 0xFF22
+  // for keys 8-15, one bit per key that reads 0 while it is held. The host
+  // queues presses and releases for given cycles in keyEvents, in cycle
+  // order, and they are only applied when the program reads the keypad, so
+  // a polling program runs the same however the host splits up the runs.
+  struct KeyEvent {
+    uint64_t cycle;
+    uint8_t key;
+    bool pressed;
+  };
+  std::deque<KeyEvent> keyEvents;
+  uint16_t keysHeld; // Bit n set while key n is held
+
+  // Port trace: writes to P0-P3 that change the port, oldest first in a
+  // ring allocated when tracing is turned on. When the host does not drain
+  // it in time, later changes are counted in portTraceLost instead of
+  // overwriting ones it has not seen.
+  std::vector<PortChange> portTrace; // Empty while tracing is off
+  uint32_t portTraceHead;            // Oldest change
+  uint32_t portTraceCount;
+  uint64_t portTraceLost;
+
+  // InterruptEvent is the first cycle an interrupt can be taken: now if an
+  // enabled source has its flag set, UINT64_MAX otherwise, so programs that
+  // never enable interrupts pay nothing.
+  uint64_t interruptHoldoff; // No interrupt is taken before this cycle
+  uint8_t interruptsActive;  // Bit 0: low priority in progress, bit 1: high
+
   bool running;
   uint64_t cycleCount;
+  uint64_t fastForwarded; // Busy-wait iterations skipped by fastForward()
+  uint64_t runEnd;        // Cycle the current run ends at
+  uint64_t endCycle;      // runEnd or an earlier event, 0 when stepping
+  StopReason stopReason;
+  uint32_t stopEvents; // Bit n set: StopReason n also ends the run
+  int32_t callDepth;   // ACALL/LCALL minus RET/RETI, for stepping
+  int32_t returnDepth; // A RET/RETI to below this depth ends the run
 
   enum class WaitType {
     None = 0,
@@ -79,2061 +855,4071 @@ private:
   bool waitingForInput;
   WaitType waitType;
 
-  // System call table for monitor routines
-  std::map<uint16_t, std::function<void()>> systemCalls;
+  // System calls for monitor routines. A CALL runs one natively when the
+  // bit for its target is set in systemCallMap. All instances share the
+  // default map until registerSystemCall gives one its own copy.
+  typedef void (Intel8051::*SystemCall)();
+  static const uint16_t systemCallBase = 0x8100;
+  static const uint32_t systemCallCount =
+#define INTEL8051_COUNT_ENTRY(name) +1
+      0 INTEL8051_SYSTEM_CALLS(INTEL8051_COUNT_ENTRY);
+#undef INTEL8051_COUNT_ENTRY
+  static const SystemCall systemCallRoutines[systemCallCount];
+  static const char *const systemCallNames[systemCallCount];
+
+  // Bits of word `word` of the default map, one per routine address
+  static constexpr uint64_t systemCallMapEntry(uint32_t word,
+                                               uint32_t call = 0) {
+    return call == systemCallCount
+               ? 0
+               : ((systemCallBase + 2 * call) >> 6 == word
+                      ? uint64_t(1) << ((systemCallBase + 2 * call) & 63)
+                      : 0) |
+                     systemCallMapEntry(word, call + 1);
+  }
+  static const uint64_t defaultSystemCallMap[1024];
+
+  const uint64_t *systemCallMap;
+  std::vector<uint64_t> customSystemCallMap;
+  std::vector<std::pair<uint16_t, SystemCall>> customSystemCalls;
+
+  // Breakpoints, one bit per code address, and watchpoints, WatchAccess bits
+  // per internal data and external RAM address. While any are set, run()
+  // goes through runDebug() instead of the dispatch engines.
+  uint64_t breakpoints[1024];
+  uint32_t breakpointCount;
+  uint8_t dataWatch[256];
+  std::vector<uint8_t> externalWatch; // Empty until one is set
+  uint32_t watchpointCount;
+  bool watchHit; // Set by watchData()/watchExternal() for the current insn
+  bool watchHitExternal;
+  uint8_t watchHitAccess;
+  uint16_t watchHitAddress;
+  uint16_t watchHitPC; // Instruction that made the access
+
+  JitMode jitMode;
+  uint64_t jitMismatches; // Blocks that failed lockstep verification
+#if INTEL8051_HAS_JIT
+  static const uint32_t jitThreshold = 16; // Runs before a block is compiled
+#endif
+#if INTEL8051_JIT_X86
+  JitCodeBuffer jitCode;
+#endif
+
+  // PSW flags are evaluated lazily. ADD, ADDC and SUBB only record the
+  // carries (borrows for SUBB) into each bit of their result, and writes to
+  // A only note the value P has to be the parity of; CY, AC, OV and P are
+  // worked out when something reads them. The PSW field holds the
+  // flags once syncFlags() has run, which translated JIT code relies on.
+  bool carriesStale; // CY/AC/OV come from carries, not the PSW bits
+  uint16_t carries;  // Operand ^ operand ^ 9-bit result
+  bool parityStale;  // P is the parity of parityOf, not the PSW bit
+  uint8_t parityOf;
+
+  // CY, AC and OV for each value of carries >> 4: CY is the carry out of
+  // bit 7, AC the carry into bit 4, OV the carry into bit 7 xor CY
+  static constexpr uint8_t arithmeticFlagsEntry(uint32_t carries) {
+    return ((carries & 0x10) << 3) | ((carries & 0x01) << 6) |
+           ((((carries >> 3) ^ (carries >> 4)) & 0x01) << 2);
+  }
+  static const uint8_t arithmeticFlags[32];
+
+  // DA A for index CY << 9 | AC << 8 | A: the adjusted A, and in bit 8
+  // whether CY is set afterwards (DA A never clears it)
+  static constexpr uint16_t decimalAdjustEntry(uint32_t index) {
+    return decimalAdjustResult(
+        index & 0xFF,
+        ((index & 0x0F) > 9 || (index & 0x100)) ? 0x06 : 0x00,
+        ((index & 0xF0) >> 4) > 9 || (index & 0x200) ||
+            (((index & 0xF0) >> 4) >= 9 && (index & 0x0F) > 9));
+  }
+  static constexpr uint16_t decimalAdjustResult(uint32_t a, uint32_t low,
+                                                bool high) {
+    return ((a + low + (high ? 0x60 : 0x00)) & 0xFF) |
+           ((high || a + low + (high ? 0x60 : 0x00) > 0xFF) ? 0x100 : 0x00);
+  }
+  static const uint16_t decimalAdjust[1024];
+
+  static bool parity(uint8_t value) {
+    value ^= value >> 4;
+    return (0x6996 >> (value & 0x0F)) & 1;
+  }
+
+  // PSW with all flags evaluated, without touching the stored copy
+  uint8_t currentPSW() const {
+    uint8_t psw = PSW;
+    if (carriesStale) {
+      psw = (psw & 0x3B) | arithmeticFlags[carries >> 4];
+    }
+    if (parityStale) {
+      psw = (psw & 0xFE) | parity(parityOf);
+    }
+    return psw;
+  }
+
+  void syncFlags() {
+    if (carriesStale || parityStale) {
+      PSW = currentPSW();
+      carriesStale = false;
+      parityStale = false;
+    }
+  }
+
+  // Records the flags of an ADD, ADDC or SUBB of rhs to or from lhs
+  void recordArithmetic(uint8_t lhs, uint8_t rhs, uint16_t result) {
+    carries = (lhs ^ rhs ^ result) & 0x1FF;
+    carriesStale = true;
+  }
 
-  // Flags in PSW
-  bool getCarryFlag() const { return PSW & 0x80; }
+  bool getCarryFlag() const {
+    if (carriesStale) {
+      return carries & 0x100;
+    }
+    return PSW & 0x80;
+  }
   void setCarryFlag(bool val) {
+    syncFlags();
     PSW = val ? (PSW | 0x80) : (PSW & 0x7F);
-    dataMemory[0xD0] = PSW; // Sync to SFR
   }
-  bool getAuxCarryFlag() const { return PSW & 0x40; }
+  bool getAuxCarryFlag() const { return currentPSW() & 0x40; }
   void setAuxCarryFlag(bool val) {
+    syncFlags();
     PSW = val ? (PSW | 0x40) : (PSW & 0xBF);
-    dataMemory[0xD0] = PSW; // Sync to SFR
   }
-  bool getOverflowFlag() const { return PSW & 0x04; }
+  bool getOverflowFlag() const { return currentPSW() & 0x04; }
   void setOverflowFlag(bool val) {
+    syncFlags();
     PSW = val ? (PSW | 0x04) : (PSW & 0xFB);
-    dataMemory[0xD0] = PSW; // Sync to SFR
   }
-  bool getParityFlag() const { return PSW & 0x01; }
+  bool getParityFlag() const { return currentPSW() & 0x01; }
   void setParityFlag(bool val) {
+    syncFlags();
     PSW = val ? (PSW | 0x01) : (PSW & 0xFE);
-    dataMemory[0xD0] = PSW; // Sync to SFR
   }
 
-  uint8_t getRegisterBank() const { return (PSW >> 3) & 0x03; }
-
   // Helper methods
-  uint8_t readDataMemory(uint8_t addr) {
-    // Sync SFR registers with their memory locations
-    if (addr == 0xE0) {
-      return A; // Accumulator
-    } else if (addr == 0xF0) {
-      return B; // B register
-    } else if (addr == 0xD0) {
-      return PSW; // PSW
-    } else if (addr == 0x81) {
-      return SP; // Stack Pointer
-    } else if (addr == 0x82) {
-      return DPTR & 0xFF; // DPL
-    } else if (addr == 0x83) {
-      return DPTR >> 8; // DPH
+  uint8_t readDataMemory(uint8_t addr) const {
+    if (addr >= 0x80 && sfrRead[addr - 0x80]) {
+      return (this->*sfrRead[addr - 0x80])(addr);
     }
     return dataMemory[addr];
   }
 
   void writeDataMemory(uint8_t addr, uint8_t value) {
+    if (addr >= 0x80 && sfrWrite[addr - 0x80]) {
+      (this->*sfrWrite[addr - 0x80])(addr, value);
+      return;
+    }
     dataMemory[addr] = value;
+  }
 
-    // Sync SFR registers with their memory locations
-    if (addr == 0xE0) {
-      A = value; // Accumulator
-      updateParity();
-    } else if (addr == 0xF0) {
-      B = value; // B register
-    } else if (addr == 0xD0) {
-      PSW = value; // PSW
-    } else if (addr == 0x81) {
-      SP = value; // Stack Pointer
-    } else if (addr == 0x82) {
-      DPTR = (DPTR & 0xFF00) | value; // DPL
-    } else if (addr == 0x83) {
-      DPTR = (DPTR & 0x00FF) | (value << 8); // DPH
+  void attachSfr(uint8_t addr, SfrRead read, SfrWrite write) {
+    sfrRead[addr - 0x80] = read;
+    sfrWrite[addr - 0x80] = write;
+  }
+
+  // Moves the event of one source; handlers reschedule their own next event
+  void scheduleEvent(EventSource source, uint64_t cycle) {
+    eventCycle[source] = cycle;
+    nextEvent = UINT64_MAX;
+    for (int i = 0; i < eventSourceCount; ++i) {
+      nextEvent = std::min(nextEvent, eventCycle[i]);
+    }
+    if (running) {
+      endCycle = std::min(runEnd, nextEvent);
     }
   }
 
-  uint8_t readRegister(uint8_t reg) {
-    uint8_t bank = getRegisterBank();
-    return dataMemory[bank * 8 + reg];
+  // Runs the handlers of all events up to cycleCount, earliest first
+  void dispatchEvents() {
+    while (nextEvent <= cycleCount) {
+      int source = 0;
+      while (eventCycle[source] != nextEvent) {
+        ++source;
+      }
+      scheduleEvent(static_cast<EventSource>(source), UINT64_MAX);
+      (this->*eventHandler[source])();
+    }
   }
 
-  void writeRegister(uint8_t reg, uint8_t value) {
-    uint8_t bank = getRegisterBank();
-    dataMemory[bank * 8 + reg] = value;
+  // SFR hooks of the CPU registers
+  uint8_t readACC(uint8_t) const { return A; }
+  void writeACC(uint8_t, uint8_t value) {
+    A = value;
+    updateParity();
+  }
+  uint8_t readB(uint8_t) const { return B; }
+  void writeB(uint8_t, uint8_t value) { B = value; }
+  uint8_t readPSW(uint8_t) const { return currentPSW(); }
+  void writePSW(uint8_t, uint8_t value) {
+    PSW = value;
+    registerBankBase = value & 0x18;
+    carriesStale = false;
+    parityStale = false;
+  }
+  uint8_t readSP(uint8_t) const { return SP; }
+  void writeSP(uint8_t, uint8_t value) { SP = value; }
+  uint8_t readDPL(uint8_t) const { return DPTR & 0xFF; }
+  void writeDPL(uint8_t, uint8_t value) { DPTR = (DPTR & 0xFF00) | value; }
+  uint8_t readDPH(uint8_t) const { return DPTR >> 8; }
+  void writeDPH(uint8_t, uint8_t value) {
+    DPTR = (DPTR & 0x00FF) | (value << 8);
   }
 
-  void updateParity() {
-    uint8_t p = 0;
-    uint8_t val = A;
-    for (int i = 0; i < 8; i++) {
-      p ^= (val & 1);
-      val >>= 1;
+  uint8_t timerMode(int timer) const { return (TMOD >> (4 * timer)) & 0x03; }
+
+  // TRx and GATE. In mode 3 TH0 takes over TR1 and TF1, and timer 1 keeps
+  // running without them unless it is in mode 3 itself, which holds it.
+  bool counterRunning(TimerCounter counter) const {
+    switch (counter) {
+    case Timer0:
+      return (TCON & 0x10) && (!(TMOD & 0x08) || (P3 & 0x04));
+    case Timer1:
+      if (timerMode(1) == 3) {
+        return false;
+      }
+      if (timerMode(0) == 3) {
+        return true;
+      }
+      return (TCON & 0x40) && (!(TMOD & 0x80) || (P3 & 0x08));
+    default:
+      return timerMode(0) == 3 && (TCON & 0x40);
     }
-    setParityFlag(p);
-    // Sync A back to memory after modification
-    dataMemory[0xE0] = A;
   }
 
-  uint8_t fetch() { return programMemory[PC++]; }
-
-  void push(uint8_t value) {
-    dataMemory[++SP] = value;
-    dataMemory[0x81] = SP; // Sync SP to SFR
+  // C/T: count falling edges on T0 (P3.4) or T1 (P3.5) instead of cycles
+  bool countsEdges(TimerCounter counter) const {
+    return (counter == Timer0 && (TMOD & 0x04)) ||
+           (counter == Timer1 && (TMOD & 0x40));
   }
 
-  uint8_t pop() {
-    uint8_t value = dataMemory[SP--];
-    dataMemory[0x81] = SP; // Sync SP to SFR
-    return value;
+  bool countsCycles(TimerCounter counter) const {
+    return counterRunning(counter) && !countsEdges(counter);
   }
 
-  // External RAM access
-  uint8_t readExternalRAM(uint16_t addr) { return externalRAM[addr]; }
+  // TCON bit a counter sets when it overflows
+  uint8_t overflowFlag(TimerCounter counter) const {
+    if (counter == Timer0) {
+      return 0x20;
+    }
+    return counter == Timer1 && timerMode(0) == 3 ? 0 : 0x80;
+  }
 
-  void writeExternalRAM(uint16_t addr, uint8_t value) {
-    externalRAM[addr] = value;
+  // Counts from low/high to the next overflow
+  uint32_t countsToOverflow(TimerCounter counter, uint8_t low,
+                            uint8_t high) const {
+    switch (counter == Timer0High ? 3 : timerMode(counter)) {
+    case 0:
+      return 0x2000 - ((high << 5) | (low & 0x1F));
+    case 1:
+      return 0x10000 - ((high << 8) | low);
+    case 2:
+      return 0x100 - low;
+    default:
+      return 0x100 - (counter == Timer0High ? high : low);
+    }
   }
 
-  // Bit-addressable memory helpers
-  void writeBit(uint8_t bitAddr, bool value) {
-    if (bitAddr < 0x80) {
-      // Bit-addressable RAM (0x20-0x2F maps to bit addresses 0x00-0x7F)
-      uint8_t byteAddr = 0x20 + (bitAddr / 8);
-      uint8_t bitPos = bitAddr % 8;
-      if (value) {
-        dataMemory[byteAddr] |= (1 << bitPos);
+  // Advances a counter's registers by count counts: 13 bits in mode 0 (the
+  // top three bits of TL are left alone), 16 in mode 1, TL reloaded from TH
+  // in mode 2 and TL0 or TH0 on its own in mode 3.
+  void advanceCounter(TimerCounter counter, uint64_t count, uint8_t &low,
+                      uint8_t &high) const {
+    uint64_t value;
+    switch (counter == Timer0High ? 3 : timerMode(counter)) {
+    case 0:
+      value = ((high << 5) | (low & 0x1F)) + count;
+      low = (low & 0xE0) | (value & 0x1F);
+      high = (value >> 5) & 0xFF;
+      break;
+    case 1:
+      value = ((high << 8) | low) + count;
+      low = value & 0xFF;
+      high = (value >> 8) & 0xFF;
+      break;
+    case 2:
+      if (count < 0x100u - low) {
+        low += count;
       } else {
-        dataMemory[byteAddr] &= ~(1 << bitPos);
+        count -= 0x100u - low;
+        low = high + count % (0x100u - high);
       }
-    } else {
-      // SFR bit-addressable (0x80, 0x88, 0x90, 0x98, 0xA0, 0xA8, 0xB0, 0xB8,
-      // etc.)
-      uint8_t byteAddr = (bitAddr & 0xF8);
-      uint8_t bitPos = bitAddr & 0x07;
-      if (value) {
-        dataMemory[byteAddr] |= (1 << bitPos);
-      } else {
-        dataMemory[byteAddr] &= ~(1 << bitPos);
+      break;
+    default:
+      uint8_t &reg = counter == Timer0High ? high : low;
+      reg = (reg + count) & 0xFF;
+      break;
+    }
+  }
+
+  // TL0, TH0, TL1 and TH1 at cycleCount
+  void currentTimers(uint8_t timers[4]) const {
+    timers[0] = TL0;
+    timers[1] = TH0;
+    timers[2] = TL1;
+    timers[3] = TH1;
+    uint64_t elapsed = cycleCount - timerBase;
+    for (int c = Timer0; c < timerCounterCount; ++c) {
+      TimerCounter counter = static_cast<TimerCounter>(c);
+      if (elapsed > 0 && countsCycles(counter)) {
+        uint8_t *regs = counter == Timer1 ? timers + 2 : timers;
+        advanceCounter(counter, elapsed, regs[0], regs[1]);
       }
     }
   }
 
-  bool readBit(uint8_t bitAddr) {
-    if (bitAddr < 0x80) {
-      // Bit-addressable RAM
-      uint8_t byteAddr = 0x20 + (bitAddr / 8);
-      uint8_t bitPos = bitAddr % 8;
-      return (dataMemory[byteAddr] >> bitPos) & 1;
-    } else {
-      // SFR bit-addressable
-      uint8_t byteAddr = (bitAddr & 0xF8);
-      uint8_t bitPos = bitAddr & 0x07;
-      return (dataMemory[byteAddr] >> bitPos) & 1;
+  // TF bits set by overflows since timerBase
+  uint8_t pendingOverflows() const {
+    uint8_t flags = 0;
+    for (int c = Timer0; c < timerCounterCount; ++c) {
+      if (cycleCount >= timerOverflow[c]) {
+        flags |= overflowFlag(static_cast<TimerCounter>(c));
+      }
     }
+    return flags;
   }
 
-  bool loadHexStream(std::istream &stream, bool verbose,
-                     const std::string &sourceLabel) {
-    std::string line;
-    uint32_t extendedAddress = 0;
+  // Counts from one overflow to the next
+  uint32_t timerPeriod(TimerCounter counter) const {
+    uint8_t high = counter == Timer1 ? TH1 : TH0;
+    bool reloads = counter != Timer0High && timerMode(counter) == 2;
+    uint8_t reload = reloads ? high : 0;
+    return countsToOverflow(counter, reload, reload);
+  }
 
-    while (std::getline(stream, line)) {
-      if (line.empty() || line[0] != ':') {
-        continue;
-      }
+  // Overflows of a counter counting cycles since timerBase
+  uint64_t overflowsSince(TimerCounter counter) const {
+    if (cycleCount < timerOverflow[counter]) {
+      return 0;
+    }
+    return 1 + (cycleCount - timerOverflow[counter]) / timerPeriod(counter);
+  }
 
-      if (line.length() < 11) {
-        std::cerr << "Warning: Invalid line in HEX data: " << line << std::endl;
-        continue;
-      }
+  // Cycle of the count-th overflow after timerBase
+  uint64_t overflowCycle(TimerCounter counter, uint64_t count) const {
+    if (timerOverflow[counter] == UINT64_MAX) {
+      return UINT64_MAX;
+    }
+    return timerOverflow[counter] + (count - 1) * timerPeriod(counter);
+  }
 
-      uint8_t byteCount = std::stoi(line.substr(1, 2), nullptr, 16);
-      uint16_t address = std::stoi(line.substr(3, 4), nullptr, 16);
-      uint8_t recordType = std::stoi(line.substr(7, 2), nullptr, 16);
+  // Stores the timers' and the serial port's current state and moves
+  // timerBase to cycleCount
+  void syncTimers() {
+    advanceSerial(serialClocksSince());
+    uint8_t timers[4];
+    currentTimers(timers);
+    TL0 = timers[0];
+    TH0 = timers[1];
+    TL1 = timers[2];
+    TH1 = timers[3];
+    TCON |= pendingOverflows();
+    timerBase = cycleCount;
+  }
 
-      if (recordType == 0x00) {
-        // Data record
-        uint32_t fullAddress = extendedAddress + address;
-        for (int i = 0; i < byteCount; i++) {
-          uint8_t byte = std::stoi(line.substr(9 + i * 2, 2), nullptr, 16);
-          if (fullAddress + i < sizeof(programMemory)) {
-            programMemory[fullAddress + i] = byte;
-          }
-        }
-      } else if (recordType == 0x01) {
-        // End of file record
-        break;
-      } else if (recordType == 0x02) {
-        // Extended segment address record
-        uint16_t segment = std::stoi(line.substr(9, 4), nullptr, 16);
-        extendedAddress = segment * 16;
-      } else if (recordType == 0x04) {
-        // Extended linear address record
-        uint16_t upper = std::stoi(line.substr(9, 4), nullptr, 16);
-        extendedAddress = upper << 16;
+  // Whether anything has to act when the counter overflows: an interrupt
+  // on its TF bit that could be taken
+  bool overflowAwaited(TimerCounter counter) const {
+    uint8_t flag = overflowFlag(counter);
+    return flag && canInterrupt(flag == 0x20 ? 1 : 3);
+  }
+
+  void scheduleTimers() {
+    uint64_t next = UINT64_MAX;
+    for (int c = Timer0; c < timerCounterCount; ++c) {
+      TimerCounter counter = static_cast<TimerCounter>(c);
+      uint8_t low = counter == Timer1 ? TL1 : TL0;
+      uint8_t high = counter == Timer1 ? TH1 : TH0;
+      timerOverflow[c] = countsCycles(counter)
+                             ? timerBase + countsToOverflow(counter, low, high)
+                             : UINT64_MAX;
+      if (overflowAwaited(counter)) {
+        next = std::min(next, timerOverflow[c]);
       }
     }
+    scheduleEvent(TimerEvent, next);
+    scheduleEvent(SerialEvent, canInterrupt(4) ? serialDeadline() : UINT64_MAX);
+    scheduleInterrupts();
+  }
 
-    if (verbose) {
-      std::cout << "Successfully loaded HEX data from " << sourceLabel
-                << std::endl;
-    }
+  // TimerEvent: the overflow is stored in TCON, where the interrupt
+  // controller sees it
+  void timerEvent() {
+    syncTimers();
+    scheduleTimers();
+  }
 
-    return true;
+  // SFR hooks of the timers
+  uint8_t readTimer(uint8_t addr) const {
+    uint8_t timers[4];
+    currentTimers(timers);
+    switch (addr) {
+    case 0x8A:
+      return timers[0];
+    case 0x8C:
+      return timers[1];
+    case 0x8B:
+      return timers[2];
+    default:
+      return timers[3];
+    }
+  }
+  uint8_t readTCON(uint8_t) const { return TCON | pendingOverflows(); }
+  void writeTCON(uint8_t, uint8_t value) {
+    syncTimers();
+    TCON = value;
+    sampleExternalInterrupts(0);
+    scheduleTimers();
+  }
+  void writeTimer(uint8_t addr, uint8_t value) {
+    syncTimers();
+    dataMemory[addr] = value;
+    scheduleTimers();
   }
 
-  void appendOutputChar(char ch) {
-    if (mirrorStdout) {
-      std::cout << ch;
-      if (ch == '\n') {
-        std::cout.flush();
+  // Port 3 holds the gate inputs INT0/INT1 and the count inputs T0/T1
+  void writeP3(uint8_t addr, uint8_t value) {
+    syncTimers();
+    uint8_t falling = P3 & ~value;
+    tracePort(addr, value);
+    P3 = value;
+    sampleExternalInterrupts(falling);
+    if ((falling & 0x10) && counterRunning(Timer0) && countsEdges(Timer0)) {
+      if (countsToOverflow(Timer0, TL0, TH0) == 1) {
+        TCON |= overflowFlag(Timer0);
       }
+      advanceCounter(Timer0, 1, TL0, TH0);
     }
-    if (captureOutput) {
-      outputBuffer.push_back(ch);
-      if (ch == '\n') {
-        outputBuffer.clear();
+    if ((falling & 0x20) && counterRunning(Timer1) && countsEdges(Timer1)) {
+      if (countsToOverflow(Timer1, TL1, TH1) == 1) {
+        TCON |= overflowFlag(Timer1);
+        if (SCON & 0x40) {
+          advanceSerial(1);
+        }
       }
+      advanceCounter(Timer1, 1, TL1, TH1);
     }
+    scheduleTimers();
   }
 
-  void appendOutputString(const std::string &text) {
-    for (char ch : text) {
-      appendOutputChar(ch);
+  // Frame length in baud clocks of the serial mode in SCON: 8 data bits at
+  // one per cycle in mode 0, 10 or 11 bits at 32 Timer 1 overflows each in
+  // modes 1 and 3 (16 with SMOD), and 11 bits at 64 oscillator periods each
+  // in mode 2 (32 with SMOD), rounded up to whole cycles
+  uint32_t serialFrameClocks() const {
+    bool smod = PCON & 0x80;
+    switch (SCON >> 6) {
+    case 0:
+      return 8;
+    case 1:
+      return smod ? 160 : 320;
+    case 2:
+      return smod ? 30 : 59;
+    default:
+      return smod ? 176 : 352;
     }
   }
 
-  void setWaitState(WaitType type) {
-    waitingForInput = true;
-    waitType = type;
+  uint64_t serialClocksSince() const {
+    return SCON & 0x40 ? overflowsSince(Timer1) : cycleCount - timerBase;
   }
 
-  void clearWaitState() {
-    waitingForInput = false;
-    waitType = WaitType::None;
+  // Cycle the first frame in flight ends at
+  uint64_t serialDeadline() const {
+    uint32_t left = serialTxLeft;
+    if (serialRxLeft > 0 && (left == 0 || serialRxLeft < left)) {
+      left = serialRxLeft;
+    }
+    if (left == 0) {
+      return UINT64_MAX;
+    }
+    return SCON & 0x40 ? overflowCycle(Timer1, left) : timerBase + left;
   }
 
-  bool consumeLine(std::string &line) {
-    auto newlineIt = std::find_if(inputBuffer.begin(), inputBuffer.end(),
+  // TI, RI and RB8 set by the frames that end within clocks baud clocks
+  uint8_t serialFlagsAfter(uint64_t clocks) const {
+    uint8_t flags = 0;
+    if (serialTxLeft > 0 && clocks >= serialTxLeft) {
+      flags |= 0x02;
+    }
+    if (serialRxLeft > 0 && clocks >= serialRxLeft) {
+      flags |= SCON & 0xC0 ? 0x05 : 0x01; // RB8 is the stop or ninth bit
+    }
+    return flags;
+  }
+
+  bool serialReceived() const {
+    return serialRxLeft > 0 && serialClocksSince() >= serialRxLeft;
+  }
+
+  void advanceSerial(uint64_t clocks) {
+    if (serialRxLeft > 0 && clocks >= serialRxLeft) {
+      SBUF = serialRxByte;
+    }
+    SCON |= serialFlagsAfter(clocks);
+    serialTxLeft = clocks < serialTxLeft ? serialTxLeft - clocks : 0;
+    serialRxLeft = clocks < serialRxLeft ? serialRxLeft - clocks : 0;
+  }
+
+  // Starts receiving the next byte from the host once the program is ready
+  // for it; the timers must be in sync
+  void receiveSerial() {
+    if (serialRxLeft == 0 && (SCON & 0x11) == 0x10 &&
+        serialInput.pop(&serialRxByte, 1) == 1) {
+      serialRxLeft = serialFrameClocks();
+    }
+  }
+
+  // Picks up bytes the host has pushed since the last run
+  void pollSerialInput() {
+    if (serialRxLeft == 0 && (SCON & 0x11) == 0x10 && !serialInput.empty()) {
+      syncTimers();
+      receiveSerial();
+      scheduleTimers();
+    }
+  }
+
+  // SerialEvent: a frame has ended while the serial interrupt is enabled
+  void serialEvent() {
+    syncTimers();
+    scheduleTimers();
+  }
+
+  // SFR hooks of the serial port
+  uint8_t readSCON(uint8_t) const {
+    return SCON | serialFlagsAfter(serialClocksSince());
+  }
+  void writeSCON(uint8_t, uint8_t value) {
+    syncTimers();
+    SCON = value;
+    receiveSerial();
+    scheduleTimers();
+  }
+  uint8_t readSBUF(uint8_t) const {
+    return serialReceived() ? serialRxByte : SBUF;
+  }
+  void writeSBUF(uint8_t, uint8_t value) {
+    syncTimers();
+    serialOutput.push(&value, 1);
+    serialTxLeft = serialFrameClocks();
+    scheduleTimers();
+  }
+
+  static const uint8_t lcdLineLength = 40;
+
+  // Rebuilds the lines of lcdScreen in lines, bit n for line n
+  void refreshLcd(uint8_t lines) {
+    bool changed = false;
+    for (int line = 0; line < 2; ++line) {
+      if (!(lines >> line & 1)) {
+        continue;
+      }
+      uint8_t row[16];
+      for (int column = 0; column < 16; ++column) {
+        uint8_t offset = (lcdShift + column) % lcdLineLength;
+        row[column] = lcdControl & 0x04 ? lcdDdram[line * 0x40 + offset] : ' ';
+      }
+      if (memcmp(row, lcdScreen[line], sizeof(row)) != 0) {
+        memcpy(lcdScreen[line], row, sizeof(row));
+        lcdDirty |= 1 << line;
+        changed = true;
+      }
+    }
+    if (changed) {
+      lcdGeneration++;
+    }
+  }
+
+  // Moves the address counter one place; DDRAM wraps from the end of one
+  // line to the start of the other
+  void stepLcdAddress(bool increment) {
+    if (lcdCgramAccess) {
+      lcdAddress = (lcdAddress + (increment ? 1 : -1)) & 0x3F;
+    } else if (increment) {
+      lcdAddress = lcdAddress == 0x27   ? 0x40
+                   : lcdAddress == 0x67 ? 0x00
+                                        : lcdAddress + 1;
+    } else {
+      lcdAddress = lcdAddress == 0x40   ? 0x27
+                   : lcdAddress == 0x00 ? 0x67
+                                        : lcdAddress - 1;
+    }
+  }
+
+  void shiftLcd(bool left) {
+    lcdShift = (lcdShift + (left ? 1 : lcdLineLength - 1)) % lcdLineLength;
+    refreshLcd(0x03);
+  }
+
+  // Executes an instruction written to the instruction register. Clear and
+  // home take 1.52 ms, everything else 37 us, at 1 us per cycle.
+  void writeLcdInstruction(uint8_t value) {
+    uint32_t busy = 37;
+    if (value & 0x80) { // Set DDRAM address
+      lcdAddress = value & 0x7F;
+      lcdCgramAccess = false;
+    } else if (value & 0x40) { // Set CGRAM address
+      lcdAddress = value & 0x3F;
+      lcdCgramAccess = true;
+    } else if (value & 0x20) {
+      // Function set: the interface width, lines and font are fixed
+    } else if (value & 0x10) { // Cursor or display shift
+      if (value & 0x08) {
+        shiftLcd(!(value & 0x04));
+      } else {
+        stepLcdAddress(value & 0x04);
+      }
+    } else if (value & 0x08) { // Display on/off control
+      lcdControl = value & 0x07;
+      refreshLcd(0x03);
+    } else if (value & 0x04) { // Entry mode set
+      lcdEntryMode = value & 0x03;
+    } else if (value & 0x03) { // Clear display or return home
+      if (value == 0x01) {
+        memset(lcdDdram, ' ', sizeof(lcdDdram));
+        lcdEntryMode |= 0x02;
+      }
+      lcdAddress = 0;
+      lcdCgramAccess = false;
+      lcdShift = 0;
+      refreshLcd(0x03);
+      busy = 1520;
+    }
+    lcdBusyUntil = cycleCount + busy;
+  }
+
+  void writeLcdData(uint8_t value) {
+    if (lcdCgramAccess) {
+      lcdCgram[lcdAddress] = value;
+    } else {
+      lcdDdram[lcdAddress] = value;
+      refreshLcd(lcdAddress & 0x40 ? 0x02 : 0x01);
+    }
+    stepLcdAddress(lcdEntryMode & 0x02);
+    if ((lcdEntryMode & 0x01) && !lcdCgramAccess) {
+      shiftLcd(lcdEntryMode & 0x02);
+    }
+    lcdBusyUntil = cycleCount + 41;
+  }
+
+  uint8_t readLcdData() {
+    uint8_t value =
+        lcdCgramAccess ? lcdCgram[lcdAddress] : lcdDdram[lcdAddress];
+    stepLcdAddress(lcdEntryMode & 0x02);
+    lcdBusyUntil = cycleCount + 41;
+    return value;
+  }
+
+  uint8_t readLcdStatus() const {
+    return (cycleCount < lcdBusyUntil ? 0x80 : 0) | lcdAddress;
+  }
+
+  // Adds cycles of lighting up what the display drives now to displayLit
+  void addDisplayLit(uint64_t cycles) {
+    if (cycles == 0 || (P1 & 0x40) || displaySegments == 0) {
+      return;
+    }
+    for (int digit = 0; digit < displayDigits; ++digit) {
+      if (!(displaySelect >> digit & 1)) {
+        continue;
+      }
+      for (int segment = 0; segment < 8; ++segment) {
+        if (displaySegments >> segment & 1) {
+          displayLit[digit][segment] += cycles;
+        }
+      }
+    }
+  }
+
+  void finishDisplayFrame() {
+    uint32_t threshold = std::max<uint32_t>(displayWindow / 32, 1);
+    uint8_t frame[displayDigits];
+    for (int digit = 0; digit < displayDigits; ++digit) {
+      frame[digit] = 0;
+      for (int segment = 0; segment < 8; ++segment) {
+        if (displayLit[digit][segment] >= threshold) {
+          frame[digit] |= 1 << segment;
+        }
+      }
+    }
+    memset(displayLit, 0, sizeof(displayLit));
+    if (memcmp(frame, displayFrame, sizeof(frame)) != 0) {
+      memcpy(displayFrame, frame, sizeof(frame));
+      displayGeneration++;
+    }
+  }
+
+  // Brings the display up to cycleCount, finishing the frames that have
+  // ended since displayBase. Nothing changed in between, so the frames
+  // after the first one all show the same and only one of them is built.
+  void syncDisplay() {
+    uint64_t frameEnd = displayStart + displayWindow;
+    if (cycleCount >= frameEnd) {
+      addDisplayLit(frameEnd - displayBase);
+      finishDisplayFrame();
+      uint64_t frames = (cycleCount - frameEnd) / displayWindow;
+      if (frames > 0) {
+        addDisplayLit(displayWindow);
+        finishDisplayFrame();
+      }
+      displayStart = displayBase = frameEnd + frames * displayWindow;
+    }
+    addDisplayLit(cycleCount - displayBase);
+    displayBase = cycleCount;
+  }
+
+  void tracePort(uint8_t addr, uint8_t value) {
+    if (portTrace.empty() || dataMemory[addr] == value) {
+      return;
+    }
+    if (portTraceCount == portTrace.size()) {
+      portTraceLost++;
+      return;
+    }
+    PortChange &change =
+        portTrace[(portTraceHead + portTraceCount++) % portTrace.size()];
+    change.cycle = cycleCount;
+    change.port = (addr - 0x80) >> 4;
+    change.value = value;
+  }
+
+  // P0 and P2 drive nothing, they are only traced
+  void writePort(uint8_t addr, uint8_t value) {
+    tracePort(addr, value);
+    dataMemory[addr] = value;
+  }
+
+  // Port 1 bit 6 turns the 7-segment display on when low
+  void writeP1(uint8_t addr, uint8_t value) {
+    if ((P1 ^ value) & 0x40) {
+      syncDisplay();
+    }
+    tracePort(addr, value);
+    P1 = value;
+  }
+
+  // Reads one half of the keypad, 0 for keys 0-7 and 1 for keys 8-15
+  uint8_t readKeypad(int half) {
+    while (!keyEvents.empty() && keyEvents.front().cycle <= cycleCount) {
+      const KeyEvent &event = keyEvents.front();
+      if (event.pressed) {
+        keysHeld |= 1 << event.key;
+      } else {
+        keysHeld &= ~(1 << event.key);
+      }
+      keyEvents.pop_front();
+    }
+    return ~(keysHeld >> (half * 8)) & 0xFF;
+  }
+
+  // Page 0xFF of the MOVX space holds the DSM-51's memory-mapped devices;
+  // addresses without one behave as memory
+  uint8_t readDevicePage(uint16_t addr) {
+    switch (addr & 0xFF) {
+    case 0x21:
+      return readKeypad(0);
+    case 0x22:
+      return readKeypad(1);
+    case 0x82:
+      return readLcdStatus();
+    case 0x83:
+      return readLcdData();
+    default:
+      return externalRAM[addr];
+    }
+  }
+  void writeDevicePage(uint16_t addr, uint8_t value) {
+    switch (addr & 0xFF) {
+    case 0x30:
+      syncDisplay();
+      displaySelect = value;
+      break;
+    case 0x38:
+      syncDisplay();
+      displaySegments = value;
+      break;
+    case 0x80:
+      writeLcdInstruction(value);
+      break;
+    case 0x81:
+      writeLcdData(value);
+      break;
+    default:
+      externalRAM[addr] = value;
+      break;
+    }
+  }
+
+  // Interrupt sources in polling order: INT0, timer 0, INT1, timer 1 and
+  // the serial port. Source n owns bit n of IE and IP and is vectored to
+  // 0x03 + 8 * n.
+  static const int interruptSourceCount = 5;
+
+  // INT0/INT1 request on a falling edge of their pin when IT0/IT1 is set,
+  // otherwise for as long as the pin is low
+  void sampleExternalInterrupts(uint8_t falling) {
+    if (TCON & 0x01) {
+      TCON |= falling & 0x04 ? 0x02 : 0;
+    } else {
+      TCON = (TCON & ~0x02) | (P3 & 0x04 ? 0 : 0x02);
+    }
+    if (TCON & 0x04) {
+      TCON |= falling & 0x08 ? 0x08 : 0;
+    } else {
+      TCON = (TCON & ~0x08) | (P3 & 0x08 ? 0 : 0x08);
+    }
+  }
+
+  bool interruptFlag(int source) const {
+    switch (source) {
+    case 0:
+      return TCON & 0x02;
+    case 1:
+      return readTCON(0x88) & 0x20;
+    case 2:
+      return TCON & 0x08;
+    case 3:
+      return readTCON(0x88) & 0x80;
+    default:
+      return readSCON(0x98) & 0x03; // RI or TI
+    }
+  }
+
+  // EA, the source's enable bit, and a priority above every interrupt in
+  // progress
+  bool canInterrupt(int source) const {
+    if (!(IE & 0x80) || !(IE >> source & 1)) {
+      return false;
+    }
+    int level = (IP >> source & 1) + 1;
+    return level > (interruptsActive & 0x02 ? 2 : interruptsActive);
+  }
+
+  // Source to vector to now: high priority first, then polling order
+  int dueInterrupt() const {
+    int due = -1;
+    for (int source = 0; source < interruptSourceCount; ++source) {
+      if (canInterrupt(source) && interruptFlag(source) &&
+          (due < 0 || (IP >> source & 1) > (IP >> due & 1))) {
+        due = source;
+      }
+    }
+    return due;
+  }
+
+  // Reschedules InterruptEvent; anything that changes a flag, an enable or
+  // a priority calls this
+  void scheduleInterrupts() {
+    scheduleEvent(InterruptEvent,
+                  dueInterrupt() >= 0 ? interruptHoldoff : UINT64_MAX);
+  }
+
+  // InterruptEvent: the hardware LCALL to the vector of the interrupt that
+  // is due. Timer flags and edge-triggered INT0/INT1 requests are cleared on
+  // the way, the serial flags are left to the handler.
+  void takeInterrupt() {
+    int source = dueInterrupt();
+    if (source < 0) {
+      scheduleInterrupts();
+      return;
+    }
+    syncTimers();
+    switch (source) {
+    case 0:
+      TCON &= TCON & 0x01 ? ~0x02 : 0xFF;
+      break;
+    case 1:
+      TCON &= ~0x20;
+      break;
+    case 2:
+      TCON &= TCON & 0x04 ? ~0x08 : 0xFF;
+      break;
+    case 3:
+      TCON &= ~0x80;
+      break;
+    }
+    push(PC & 0xFF);
+    push(PC >> 8);
+    PC = 0x03 + 8 * source;
+    callDepth++;
+    cycleCount += 2;
+    interruptsActive |= IP >> source & 1 ? 0x02 : 0x01;
+    interruptHoldoff = cycleCount + 1; // The handler runs one instruction
+    scheduleTimers();
+  }
+
+  // The run loops call this once cycleCount reaches endCycle. Runs the
+  // events that are due, if that is why, and returns whether the run goes
+  // on; a call to an interrupt vector may use up the rest of the budget.
+  bool continueRun() {
+    if (!running || cycleCount >= runEnd) {
+      return false;
+    }
+    dispatchEvents();
+    return cycleCount < endCycle;
+  }
+
+  // SFR hooks of the interrupt controller. Changing IE or IP lets one more
+  // instruction run before an interrupt, like RETI. They also decide which
+  // timer overflows are waited for.
+  void writeInterruptControl(uint8_t addr, uint8_t value) {
+    dataMemory[addr] = value;
+    interruptHoldoff = cycleCount + 1;
+    scheduleTimers();
+  }
+
+  // Writes to these can move the next event
+  static bool isEventSfr(uint8_t addr) {
+    return (addr >= 0x88 && addr <= 0x8D) || addr == 0x98 || addr == 0x99 ||
+           addr == 0xA8 || addr == 0xB0 || addr == 0xB8;
+  }
+
+  void initSfrHooks() {
+    for (int i = 0; i < 128; ++i) {
+      sfrRead[i] = nullptr;
+      sfrWrite[i] = nullptr;
+    }
+    attachSfr(0xE0, &Intel8051::readACC, &Intel8051::writeACC);
+    attachSfr(0xF0, &Intel8051::readB, &Intel8051::writeB);
+    attachSfr(0xD0, &Intel8051::readPSW, &Intel8051::writePSW);
+    attachSfr(0x81, &Intel8051::readSP, &Intel8051::writeSP);
+    attachSfr(0x82, &Intel8051::readDPL, &Intel8051::writeDPL);
+    attachSfr(0x83, &Intel8051::readDPH, &Intel8051::writeDPH);
+    attachSfr(0x88, &Intel8051::readTCON, &Intel8051::writeTCON);
+    attachSfr(0x89, nullptr, &Intel8051::writeTimer);
+    for (uint8_t addr = 0x8A; addr <= 0x8D; ++addr) {
+      attachSfr(addr, &Intel8051::readTimer, &Intel8051::writeTimer);
+    }
+    attachSfr(0x80, nullptr, &Intel8051::writePort);
+    attachSfr(0x90, nullptr, &Intel8051::writeP1);
+    attachSfr(0xA0, nullptr, &Intel8051::writePort);
+    attachSfr(0xB0, nullptr, &Intel8051::writeP3);
+    attachSfr(0x98, &Intel8051::readSCON, &Intel8051::writeSCON);
+    attachSfr(0x99, &Intel8051::readSBUF, &Intel8051::writeSBUF);
+    attachSfr(0xA8, nullptr, &Intel8051::writeInterruptControl);
+    attachSfr(0xB8, nullptr, &Intel8051::writeInterruptControl);
+  }
+
+  void initEventHandlers() {
+    eventHandler[TimerEvent] = &Intel8051::timerEvent;
+    eventHandler[SerialEvent] = &Intel8051::serialEvent;
+    eventHandler[InterruptEvent] = &Intel8051::takeInterrupt;
+  }
+
+  uint8_t readRegister(uint8_t reg) const {
+    return dataMemory[registerBankBase + reg];
+  }
+
+  void writeRegister(uint8_t reg, uint8_t value) {
+    dataMemory[registerBankBase + reg] = value;
+  }
+
+  void updateParity() {
+    parityOf = A;
+    parityStale = true;
+  }
+
+  void push(uint8_t value) { dataMemory[++SP] = value; }
+
+  uint8_t pop() { return dataMemory[SP--]; }
+
+  // External RAM access
+  uint8_t readExternalRAM(uint16_t addr) {
+    XramRead read = xramRead[addr >> 8];
+    return read ? (this->*read)(addr) : externalRAM[addr];
+  }
+
+  void writeExternalRAM(uint16_t addr, uint8_t value) {
+    XramWrite write = xramWrite[addr >> 8];
+    if (write) {
+      (this->*write)(addr, value);
+      return;
+    }
+    externalRAM[addr] = value;
+  }
+
+  // Routes pages first to first + count - 1 of the MOVX space to a device
+  void attachXram(uint8_t first, int count, XramRead read, XramWrite write) {
+    for (int page = first; page < first + count; ++page) {
+      xramRead[page] = read;
+      xramWrite[page] = write;
+    }
+  }
+
+  void initXramHooks() {
+    for (int page = 0; page < 256; ++page) {
+      xramRead[page] = nullptr;
+      xramWrite[page] = nullptr;
+    }
+    attachXram(0xFF, 1, &Intel8051::readDevicePage,
+               &Intel8051::writeDevicePage);
+  }
+
+  // Bit-addressable memory helpers
+  void writeBit(uint8_t bitAddr, bool value) {
+    if (bitAddr < 0x80) {
+      // Bit-addressable RAM (0x20-0x2F maps to bit addresses 0x00-0x7F)
+      uint8_t byteAddr = 0x20 + (bitAddr / 8);
+      uint8_t bitPos = bitAddr % 8;
+      if (value) {
+        dataMemory[byteAddr] |= (1 << bitPos);
+      } else {
+        dataMemory[byteAddr] &= ~(1 << bitPos);
+      }
+    } else {
+      // SFR bit-addressable (0x80, 0x88, 0x90, 0x98, 0xA0, 0xA8, 0xB0, 0xB8,
+      // etc.)
+      uint8_t byteAddr = (bitAddr & 0xF8);
+      uint8_t bitPos = bitAddr & 0x07;
+      uint8_t byte = readDataMemory(byteAddr);
+      if (value) {
+        writeDataMemory(byteAddr, byte | (1 << bitPos));
+      } else {
+        writeDataMemory(byteAddr, byte & ~(1 << bitPos));
+      }
+    }
+  }
+
+  bool readBit(uint8_t bitAddr) {
+    if (bitAddr < 0x80) {
+      // Bit-addressable RAM
+      uint8_t byteAddr = 0x20 + (bitAddr / 8);
+      uint8_t bitPos = bitAddr % 8;
+      return (dataMemory[byteAddr] >> bitPos) & 1;
+    } else {
+      // SFR bit-addressable
+      uint8_t byteAddr = (bitAddr & 0xF8);
+      uint8_t bitPos = bitAddr & 0x07;
+      return (readDataMemory(byteAddr) >> bitPos) & 1;
+    }
+  }
+
+  bool loadHexStream(std::istream &stream, bool verbose,
+                     const std::string &sourceLabel) {
+    std::string line;
+    uint32_t extendedAddress = 0;
+
+    while (std::getline(stream, line)) {
+      if (line.empty() || line[0] != ':') {
+        continue;
+      }
+
+      if (line.length() < 11) {
+        std::cerr << "Warning: Invalid line in HEX data: " << line << std::endl;
+        continue;
+      }
+
+      uint8_t byteCount = std::stoi(line.substr(1, 2), nullptr, 16);
+      uint16_t address = std::stoi(line.substr(3, 4), nullptr, 16);
+      uint8_t recordType = std::stoi(line.substr(7, 2), nullptr, 16);
+
+      if (recordType == 0x00) {
+        // Data record
+        uint32_t fullAddress = extendedAddress + address;
+        for (int i = 0; i < byteCount; i++) {
+          uint8_t byte = std::stoi(line.substr(9 + i * 2, 2), nullptr, 16);
+          if (fullAddress + i < sizeof(programMemory)) {
+            programMemory[fullAddress + i] = byte;
+          }
+        }
+      } else if (recordType == 0x01) {
+        // End of file record
+        break;
+      } else if (recordType == 0x02) {
+        // Extended segment address record
+        uint16_t segment = std::stoi(line.substr(9, 4), nullptr, 16);
+        extendedAddress = segment * 16;
+      } else if (recordType == 0x04) {
+        // Extended linear address record
+        uint16_t upper = std::stoi(line.substr(9, 4), nullptr, 16);
+        extendedAddress = upper << 16;
+      }
+    }
+
+    refreshDecodeCache();
+
+    if (verbose) {
+      std::cout << "Successfully loaded HEX data from " << sourceLabel
+                << std::endl;
+    }
+
+    return true;
+  }
+
+  void appendOutputChar(char ch) {
+    if (stopEvents & (1u << static_cast<int>(StopReason::Output))) {
+      stopRun(StopReason::Output);
+    }
+    if (mirrorStdout) {
+      std::cout << ch;
+      if (ch == '\n') {
+        std::cout.flush();
+      }
+    }
+    if (captureOutput) {
+      outputBuffer.push_back(ch);
+      if (ch == '\n') {
+        outputBuffer.clear();
+      }
+    }
+  }
+
+  void appendOutputString(const std::string &text) {
+    for (char ch : text) {
+      appendOutputChar(ch);
+    }
+  }
+
+  void setWaitState(WaitType type) {
+    waitingForInput = true;
+    waitType = type;
+  }
+
+  void clearWaitState() {
+    waitingForInput = false;
+    waitType = WaitType::None;
+  }
+
+  bool consumeLine(std::string &line) {
+    auto newlineIt = std::find_if(inputBuffer.begin(), inputBuffer.end(),
                                   [](char c) { return c == '\n'; });
     if (newlineIt == inputBuffer.end()) {
       return false;
     }
 
-    line.assign(inputBuffer.begin(), newlineIt);
-    auto eraseEnd = newlineIt;
-    ++eraseEnd;
-    inputBuffer.erase(inputBuffer.begin(), eraseEnd);
-    return true;
+    line.assign(inputBuffer.begin(), newlineIt);
+    auto eraseEnd = newlineIt;
+    ++eraseEnd;
+    inputBuffer.erase(inputBuffer.begin(), eraseEnd);
+    return true;
+  }
+
+  bool consumeChar(char &ch) {
+    if (inputBuffer.empty()) {
+      return false;
+    }
+    ch = inputBuffer.front();
+    inputBuffer.pop_front();
+    return true;
+  }
+
+  // Monitor/BIOS functions for dsm-51 compatibility
+  // DSM-51 System Calls
+
+  void syscall_WRITE_TEXT() {
+    // 0x8100 - Write text to LCD (null-terminated string from DPTR)
+    uint16_t addr = DPTR;
+    while (true) {
+      uint8_t ch = programMemory[addr++];
+      if (ch == 0 || addr == 0)
+        break;
+      appendOutputChar(static_cast<char>(ch));
+      writeLcdData(ch);
+    }
+  }
+
+  void syscall_WRITE_DATA() {
+    // 0x8102 - Write character to LCD (from A)
+    appendOutputChar(static_cast<char>(A));
+    writeLcdData(A);
+  }
+
+  void syscall_WRITE_HEX() {
+    // 0x8104 - Write hex number to LCD (from A)
+    std::ostringstream oss;
+    oss << std::hex << std::uppercase << std::setw(2) << std::setfill('0')
+        << static_cast<int>(A);
+    appendOutputString(oss.str());
+    for (char ch : oss.str()) {
+      writeLcdData(ch);
+    }
+  }
+
+  void syscall_WRITE_INSTR() {
+    // 0x8106 - Send instruction to LCD (from A)
+    writeLcdInstruction(A);
+  }
+
+  void syscall_LCD_INIT() {
+    // 0x8108 - Initialize LCD: 8 bits, 2 lines, display on, clear, increment
+    appendOutputString("[LCD INIT]\n");
+    writeLcdInstruction(0x38);
+    writeLcdInstruction(0x0C);
+    writeLcdInstruction(0x01);
+    writeLcdInstruction(0x06);
+  }
+
+  void syscall_LCD_OFF() {
+    // 0x810A - Turn off LCD
+    appendOutputString("[LCD OFF]\n");
+    writeLcdInstruction(0x08);
+  }
+
+  void syscall_LCD_CLR() {
+    // 0x810C - Clear LCD
+    appendOutputString("\n");
+    writeLcdInstruction(0x01);
+  }
+
+  void syscall_DELAY_US() {
+    // 0x810E - Delay (2*A+6)*12/11.059 microseconds
+    uint32_t us = (2 * A + 6) * 12 / 11;
+    cycleCount += us / 10; // Approximate cycle count
+  }
+
+  void syscall_DELAY_MS() {
+    // 0x8110 - Delay A milliseconds
+    cycleCount += A * 1000; // ~1000 cycles per ms at 12MHz
+  }
+
+  void syscall_DELAY_100MS() {
+    // 0x8112 - Delay A * 100 milliseconds
+    cycleCount += A * 100000; // ~100,000 cycles per 100ms
+  }
+
+  void syscall_WAIT_ENTER() {
+    // 0x8114 - Display "PRESS ENTER" and wait for ENTER
+    if (!waitingForInput || waitType != WaitType::WaitEnter) {
+      appendOutputString("PRESS ENTER.\n");
+    }
+
+    std::string line;
+    if (consumeLine(line)) {
+      clearWaitState();
+    } else {
+      setWaitState(WaitType::WaitEnter);
+    }
+  }
+
+  void syscall_WAIT_ENTER_NW() {
+    // 0x8116 - Wait for ENTER key (no message)
+    std::string line;
+    if (consumeLine(line)) {
+      clearWaitState();
+    } else {
+      setWaitState(WaitType::WaitEnterNW);
+    }
+  }
+
+  void syscall_TEST_ENTER() {
+    // 0x8118 - Test if ENTER key is pressed (non-blocking would be ideal)
+    setCarryFlag(false);
+  }
+
+  void syscall_WAIT_ENT_ESC() {
+    // 0x811A - Wait for ENTER or ESC
+    char ch;
+    if (!consumeChar(ch)) {
+      setWaitState(WaitType::WaitEnterEsc);
+      return;
+    }
+
+    clearWaitState();
+    A = static_cast<uint8_t>(ch);
+
+    if (ch == '\n') {
+      setCarryFlag(false); // ENTER pressed
+    } else if (static_cast<unsigned char>(ch) == 27) {
+      setCarryFlag(true); // ESC pressed
+    }
+  }
+
+  void syscall_WAIT_KEY() {
+    // 0x811C - Wait for any key (accepts 0-9, a-f/A-F for values 0-15)
+    std::string line;
+    if (!consumeLine(line)) {
+      setWaitState(WaitType::WaitKey);
+      return;
+    }
+
+    clearWaitState();
+
+    if (line.empty()) {
+      A = 0;
+      return;
+    }
+
+    char ch = line[0];
+    if (ch >= '0' && ch <= '9') {
+      A = ch - '0';
+    } else if (ch >= 'a' && ch <= 'f') {
+      A = 10 + (ch - 'a');
+    } else if (ch >= 'A' && ch <= 'F') {
+      A = 10 + (ch - 'A');
+    } else {
+      A = 0;
+    }
+  }
+
+  void syscall_GET_NUM() {
+    // 0x811E - Read BCD number (4 digits)
+    std::string line;
+    if (!consumeLine(line)) {
+      setWaitState(WaitType::GetNum);
+      return;
+    }
+
+    clearWaitState();
+
+    std::istringstream iss(line);
+    std::string token;
+    iss >> token;
+
+    auto isDigit = [](char ch) {
+      return std::isdigit(static_cast<unsigned char>(ch));
+    };
+
+    if (token.length() >= 4 && isDigit(token[0]) && isDigit(token[1]) &&
+        isDigit(token[2]) && isDigit(token[3])) {
+      writeRegister(3, ((token[0] - '0') << 4) | (token[1] - '0'));
+      writeRegister(2, ((token[2] - '0') << 4) | (token[3] - '0'));
+    }
+  }
+
+  void syscall_BCD_HEX() {
+    // 0x8120 - Convert BCD to HEX (R3:R2 -> R3:R2)
+    uint8_t bcd_high = readRegister(3);
+    uint8_t bcd_low = readRegister(2);
+    uint16_t bcd = (bcd_high << 8) | bcd_low;
+
+    uint16_t hex = ((bcd >> 12) & 0x0F) * 1000 + ((bcd >> 8) & 0x0F) * 100 +
+                   ((bcd >> 4) & 0x0F) * 10 + (bcd & 0x0F);
+
+    writeRegister(3, hex >> 8);
+    writeRegister(2, hex & 0xFF);
+  }
+
+  void syscall_HEX_BCD() {
+    // 0x8122 - Convert HEX to BCD (R3:R2 -> R3:R2)
+    uint16_t hex = (readRegister(3) << 8) | readRegister(2);
+
+    uint8_t thousands = (hex / 1000) % 10;
+    uint8_t hundreds = (hex / 100) % 10;
+    uint8_t tens = (hex / 10) % 10;
+    uint8_t ones = hex % 10;
+
+    writeRegister(3, (thousands << 4) | hundreds);
+    writeRegister(2, (tens << 4) | ones);
+  }
+
+  void syscall_MUL_2_2() {
+    // 0x8124 - Multiply 2-byte numbers (R3:R2 * R5:R4 -> R7:R6:R5:R4)
+    uint16_t a = (readRegister(3) << 8) | readRegister(2);
+    uint16_t b = (readRegister(5) << 8) | readRegister(4);
+    uint32_t result = (uint32_t)a * (uint32_t)b;
+
+    writeRegister(7, (result >> 24) & 0xFF);
+    writeRegister(6, (result >> 16) & 0xFF);
+    writeRegister(5, (result >> 8) & 0xFF);
+    writeRegister(4, result & 0xFF);
+  }
+
+  void syscall_MUL_3_1() {
+    // 0x8126 - Multiply 3 bytes * 1 byte (R4:R3:R2 * R5 -> R7:R6:R5:R4)
+    uint32_t a = ((uint32_t)readRegister(4) << 16) |
+                 ((uint32_t)readRegister(3) << 8) | readRegister(2);
+    uint8_t b = readRegister(5);
+    uint32_t result = a * b;
+
+    writeRegister(7, (result >> 24) & 0xFF);
+    writeRegister(6, (result >> 16) & 0xFF);
+    writeRegister(5, (result >> 8) & 0xFF);
+    writeRegister(4, result & 0xFF);
+  }
+
+  void syscall_DIV_2_1() {
+    // 0x8128 - Divide 2 bytes / 1 byte (R3:R2 / R4 -> R3:R2 quotient, R5
+    // remainder)
+    uint16_t dividend = (readRegister(3) << 8) | readRegister(2);
+    uint8_t divisor = readRegister(4);
+
+    if (divisor != 0) {
+      uint16_t quotient = dividend / divisor;
+      uint8_t remainder = dividend % divisor;
+
+      writeRegister(3, quotient >> 8);
+      writeRegister(2, quotient & 0xFF);
+      writeRegister(5, remainder);
+      setOverflowFlag(false);
+    } else {
+      setOverflowFlag(true); // Division by zero
+    }
+  }
+
+  void syscall_DIV_4_2() {
+    // 0x812A - Divide 4 bytes / 2 bytes (R7:R6:R5:R4 / R3:R2 -> R5:R4 quotient,
+    // R7:R6 remainder)
+    uint32_t dividend = ((uint32_t)readRegister(7) << 24) |
+                        ((uint32_t)readRegister(6) << 16) |
+                        ((uint32_t)readRegister(5) << 8) | readRegister(4);
+    uint16_t divisor = (readRegister(3) << 8) | readRegister(2);
+
+    if (divisor != 0) {
+      uint32_t quotient = dividend / divisor;
+      uint32_t remainder = dividend % divisor;
+
+      writeRegister(5, (quotient >> 8) & 0xFF);
+      writeRegister(4, quotient & 0xFF);
+      writeRegister(7, (remainder >> 8) & 0xFF);
+      writeRegister(6, remainder & 0xFF);
+      setOverflowFlag(false);
+    } else {
+      setOverflowFlag(true); // Division by zero
+    }
+  }
+
+  bool isSystemCall(uint16_t address) const {
+    return systemCallMap[address >> 6] >> (address & 63) & 1;
+  }
+
+  SystemCall systemCallAt(uint16_t address) const {
+    for (const auto &call : customSystemCalls) {
+      if (call.first == address) {
+        return call.second;
+      }
+    }
+    return systemCallRoutines[(address - systemCallBase) >> 1];
+  }
+
+  SystemCallResult handleSystemCall(uint16_t address) {
+    if (!isSystemCall(address)) {
+      return SystemCallResult::NotHandled;
+    }
+    (this->*systemCallAt(address))(); // Execute the system call
+    if (waitingForInput) {
+      return SystemCallResult::Pending;
+    }
+    return SystemCallResult::Handled;
+  }
+
+public:
+  Intel8051()
+      : P0(dataMemory[0x80]), P1(dataMemory[0x90]), P2(dataMemory[0xA0]),
+        P3(dataMemory[0xB0]), IE(dataMemory[0xA8]), IP(dataMemory[0xB8]),
+        TMOD(dataMemory[0x89]), TCON(dataMemory[0x88]), TH0(dataMemory[0x8C]),
+        TL0(dataMemory[0x8A]), TH1(dataMemory[0x8D]), TL1(dataMemory[0x8B]),
+        SCON(dataMemory[0x98]), SBUF(dataMemory[0x99]), PCON(dataMemory[0x87]),
+        lcdGeneration(0), lcdDirty(0), displayWindow(16667),
+        displayGeneration(0), running(false), cycleCount(0), runEnd(0),
+        endCycle(0),
+        stopReason(StopReason::CycleLimit), stopEvents(0), callDepth(0),
+        returnDepth(INT32_MIN), captureOutput(false),
+        mirrorStdout(true), waitingForInput(false), waitType(WaitType::None),
+        systemCallMap(defaultSystemCallMap), breakpointCount(0),
+        watchpointCount(0), watchHit(false), watchHitExternal(false),
+        watchHitAccess(0), watchHitAddress(0), watchHitPC(0),
+        jitMode(JitMode::Off), jitMismatches(0) {
+    memset(breakpoints, 0, sizeof(breakpoints));
+    memset(lcdScreen, 0, sizeof(lcdScreen));
+    memset(displayFrame, 0, sizeof(displayFrame));
+    memset(dataWatch, 0, sizeof(dataWatch));
+    initSfrHooks();
+    initXramHooks();
+    initEventHandlers();
+    reset();
+  }
+
+#if INTEL8051_JIT_WASM
+  // The translated blocks live in the module's function table, not in the
+  // emulator, so they have to be handed back explicitly
+  ~Intel8051() { jitReleaseWasm(this); }
+#endif
+
+  void reset() {
+    memset(programMemory, 0, sizeof(programMemory));
+    memset(dataMemory, 0, sizeof(dataMemory));
+    memset(externalRAM, 0, sizeof(externalRAM));
+
+    A = 0;
+    B = 0;
+    DPTR = 0;
+    SP = 0x07; // Stack pointer starts at 0x07
+    PC = 0;
+    PSW = 0;
+    registerBankBase = 0;
+    carriesStale = false;
+    parityStale = false;
+    parityOf = 0;
+
+    P0 = P1 = P2 = P3 = 0xFF; // Ports default to high
+
+    running = false;
+    cycleCount = 0;
+    fastForwarded = 0;
+    callDepth = 0;
+    interruptHoldoff = 0;
+    interruptsActive = 0;
+    for (int i = 0; i < eventSourceCount; ++i) {
+      eventCycle[i] = UINT64_MAX;
+    }
+    nextEvent = UINT64_MAX;
+    timerBase = 0;
+    serialTxLeft = 0;
+    serialRxLeft = 0;
+    serialRxByte = 0;
+    serialInput.clear();
+    serialOutput.clear();
+    scheduleTimers();
+
+    // The monitor leaves the LCD cleared and on, with the cursor hidden
+    memset(lcdDdram, ' ', sizeof(lcdDdram));
+    memset(lcdCgram, 0, sizeof(lcdCgram));
+    lcdAddress = 0;
+    lcdCgramAccess = false;
+    lcdEntryMode = 0x02;
+    lcdControl = 0x04;
+    lcdShift = 0;
+    lcdBusyUntil = 0;
+    refreshLcd(0x03);
+    displaySelect = 0;
+    displaySegments = 0;
+    displayStart = displayBase = 0;
+    memset(displayLit, 0, sizeof(displayLit));
+    finishDisplayFrame();
+    keyEvents.clear();
+    keysHeld = 0;
+    portTraceHead = 0;
+    portTraceCount = 0;
+    portTraceLost = 0;
+    decodeCacheStale = true;
+
+    inputBuffer.clear();
+    outputBuffer.clear();
+    clearWaitState();
+  }
+
+  bool loadHexFromString(const std::string &hexData) {
+    std::istringstream stream(hexData);
+    return loadHexStream(stream, false, "string input");
+  }
+
+  bool loadHexFile(const std::string &filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+      std::cerr << "Error: Could not open file " << filename << std::endl;
+      return false;
+    }
+
+    bool result = loadHexStream(file, true, filename);
+    file.close();
+    return result;
+  }
+
+  void setOutputOptions(bool capture, bool mirror) {
+    captureOutput = capture;
+    mirrorStdout = mirror;
+    if (!captureOutput) {
+      outputBuffer.clear();
+    }
+  }
+
+  size_t readOutput(char *buffer, size_t maxLen) {
+    if (!buffer || maxLen == 0) {
+      return 0;
+    }
+
+    size_t count = 0;
+    while (count < maxLen && !outputBuffer.empty()) {
+      buffer[count++] = outputBuffer.front();
+      outputBuffer.pop_front();
+    }
+    return count;
+  }
+
+  std::string readOutputString() {
+    std::string result(outputBuffer.begin(), outputBuffer.end());
+    outputBuffer.clear();
+    return result;
+  }
+
+  size_t getOutputSize() const { return outputBuffer.size(); }
+
+  void clearOutputBuffer() { outputBuffer.clear(); }
+
+  void pushInput(const char *data, size_t length) {
+    if (!data) {
+      return;
+    }
+    for (size_t i = 0; i < length; ++i) {
+      char ch = data[i];
+      if (ch == '\r') {
+        continue;
+      }
+      inputBuffer.push_back(ch);
+    }
+  }
+
+  void pushInput(const std::string &text) {
+    pushInput(text.data(), text.size());
+  }
+
+  // Bytes for the serial port's receiver; returns how many fitted
+  size_t pushSerialInput(const uint8_t *data, size_t length) {
+    return serialInput.push(data, length);
+  }
+
+  // Bytes the program has sent through the serial port
+  size_t readSerialOutput(uint8_t *buffer, size_t maxLen) {
+    return serialOutput.pop(buffer, maxLen);
+  }
+
+  const uint8_t *getLcdScreen() const { return &lcdScreen[0][0]; }
+
+  uint32_t getLcdGeneration() const { return lcdGeneration; }
+
+  // Lines changed since the last call, bit n for line n
+  uint8_t takeLcdDirty() {
+    uint8_t dirty = lcdDirty;
+    lcdDirty = 0;
+    return dirty;
+  }
+
+  // Row * 16 + column of the cursor, -1 when it is hidden or off screen
+  int getLcdCursor() const {
+    if ((lcdControl & 0x07) <= 0x04 || lcdCgramAccess) {
+      return -1;
+    }
+    int column = ((lcdAddress & 0x3F) + lcdLineLength - lcdShift) %
+                 lcdLineLength;
+    return column < 16 ? (lcdAddress >> 6) * 16 + column : -1;
+  }
+
+  // Finishes the display frames that have ended by now and returns the
+  // generation of the last one
+  uint32_t pollDisplay() {
+    syncDisplay();
+    return displayGeneration;
+  }
+
+  // Segments shown on each digit in the last frame, bit 0 for segment a
+  const uint8_t *getDisplayFrame() const { return displayFrame; }
+
+  // Starts a new frame of the given length from now
+  void setDisplayWindow(uint32_t cycles) {
+    syncDisplay();
+    memset(displayLit, 0, sizeof(displayLit));
+    displayWindow = std::max<uint32_t>(cycles, 1);
+    displayStart = cycleCount;
+  }
+
+  // Queues keypad key 0-15 to be pressed or released at cycle. Events for
+  // the same cycle apply in the order they were queued.
+  void queueKeyEvent(uint8_t key, bool pressed, uint64_t cycle) {
+    if (key >= 16) {
+      return;
+    }
+    // Hosts mostly queue in cycle order, so look from the back
+    auto at = keyEvents.end();
+    while (at != keyEvents.begin() && (at - 1)->cycle > cycle) {
+      --at;
+    }
+    KeyEvent event = {cycle, key, pressed};
+    keyEvents.insert(at, event);
+  }
+
+  // Traces the changes of P0-P3 into a ring of capacity entries, or stops
+  // tracing when it is 0. Changes not drained yet are dropped.
+  void setPortTrace(uint32_t capacity) {
+    portTrace.assign(capacity, PortChange());
+    portTrace.shrink_to_fit();
+    portTraceHead = 0;
+    portTraceCount = 0;
+    portTraceLost = 0;
+  }
+
+  // Moves up to maxChanges of the oldest traced changes into buffer and
+  // returns how many there were
+  size_t drainPortTrace(PortChange *buffer, size_t maxChanges) {
+    size_t count = std::min<size_t>(maxChanges, portTraceCount);
+    for (size_t i = 0; i < count; ++i) {
+      buffer[i] = portTrace[portTraceHead];
+      portTraceHead = (portTraceHead + 1) % portTrace.size();
+    }
+    portTraceCount -= count;
+    return count;
+  }
+
+  // Changes the trace had no room for
+  uint64_t getPortTraceLost() const { return portTraceLost; }
+
+  bool isWaitingForInput() const { return waitingForInput; }
+
+  int getWaitTypeCode() const { return static_cast<int>(waitType); }
+
+  uint64_t getCycleCount() const { return cycleCount; }
+
+  // Instructions charged without being run, see fastForward()
+  uint64_t getFastForwarded() const { return fastForwarded; }
+
+  void getStateSnapshot(EmulatorState &state) const {
+    state.cycles = cycleCount;
+    state.pc = PC;
+    state.dptr = DPTR;
+    state.sp = SP;
+    state.a = A;
+    state.b = B;
+    state.psw = currentPSW();
+    state.p0 = P0;
+    state.p1 = P1;
+    state.p2 = P2;
+    state.p3 = P3;
   }
 
-  bool consumeChar(char &ch) {
-    if (inputBuffer.empty()) {
-      return false;
+  // Read a byte from memory (for external access)
+  uint8_t readMemoryByte(size_t offset) const {
+    if (offset < 256) {
+      // Internal RAM (0x00-0xFF), SFRs as a direct access would see them
+      return readDataMemory(static_cast<uint8_t>(offset));
+    } else {
+      // External RAM (256+)
+      uint16_t extAddr = static_cast<uint16_t>(offset - 256);
+      return externalRAM[extAddr];
     }
-    ch = inputBuffer.front();
-    inputBuffer.pop_front();
-    return true;
   }
 
-  // Monitor/BIOS functions for dsm-51 compatibility
-  // DSM-51 System Calls
+private:
+  // Opcode handlers. Each one is entered with PC already pointing at the next
+  // instruction and the instruction's cycles already counted; operands and
+  // branch targets come from the predecoded entry. Rn handlers are templates
+  // over the register number n, one instance per opcode.
 
-  void syscall_WRITE_TEXT() {
-    // 0x8100 - Write text to LCD (null-terminated string from DPTR)
-    uint16_t addr = DPTR;
-    while (true) {
-      uint8_t ch = programMemory[addr++];
-      if (ch == 0 || addr == 0)
-        break;
-      appendOutputChar(static_cast<char>(ch));
-    }
+  // 0x0X - NOP, AJMP, LJMP, RR, INC variants
+  void op_NOP(const DecodedInstruction &) {}
+
+  void op_AJMP(const DecodedInstruction &insn) { jumpTo(insn); }
+
+  void op_LJMP(const DecodedInstruction &insn) { jumpTo(insn); }
+
+  void op_RR_A(const DecodedInstruction &) { A = (A >> 1) | (A << 7); }
+
+  void op_INC_A(const DecodedInstruction &) {
+    A++;
+    updateParity();
   }
 
-  void syscall_WRITE_DATA() {
-    // 0x8102 - Write character to LCD (from A)
-    appendOutputChar(static_cast<char>(A));
+  void op_INC_direct(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeDataMemory(addr, readDataMemory(addr) + 1);
   }
 
-  void syscall_WRITE_HEX() {
-    // 0x8104 - Write hex number to LCD (from A)
-    std::ostringstream oss;
-    oss << std::hex << std::uppercase << std::setw(2) << std::setfill('0')
-        << static_cast<int>(A);
-    appendOutputString(oss.str());
+  void op_INC_indirect(const DecodedInstruction &insn) {
+    uint8_t reg = insn.opcode & 0x01;
+    writeDataMemory(readRegister(reg), readDataMemory(readRegister(reg)) + 1);
   }
 
-  void syscall_WRITE_INSTR() {
-    // 0x8106 - Send instruction to LCD
+  template <uint8_t n> void op_INC_Rn(const DecodedInstruction &) {
+    writeRegister(n, readRegister(n) + 1);
   }
 
-  void syscall_LCD_INIT() {
-    // 0x8108 - Initialize LCD
-    appendOutputString("[LCD INIT]\n");
+  // 0x1X - JBC, ACALL, LCALL, RRC, DEC variants
+  void op_JBC(const DecodedInstruction &insn) {
+    uint8_t bitAddr = insn.operand1;
+    if (readBit(bitAddr)) {
+      writeBit(bitAddr, false);
+      PC = insn.target;
+    }
   }
 
-  void syscall_LCD_OFF() {
-    // 0x810A - Turn off LCD
-    appendOutputString("[LCD OFF]\n");
+  // ACALL and LCALL
+  void op_CALL(const DecodedInstruction &insn) {
+    SystemCallResult callResult = handleSystemCall(insn.target);
+
+    if (callResult == SystemCallResult::Pending) {
+      // Re-execute the call instruction once input is available
+      PC -= insn.length;
+      cycleCount -= insn.cycles;
+      stopRun(StopReason::WaitingForInput);
+    } else if (callResult == SystemCallResult::NotHandled) {
+      push(PC & 0xFF);
+      push(PC >> 8);
+      PC = insn.target;
+      callDepth++;
+    }
   }
 
-  void syscall_LCD_CLR() {
-    // 0x810C - Clear LCD
-    appendOutputString("\n");
+  void op_RRC_A(const DecodedInstruction &) {
+    bool oldCarry = getCarryFlag();
+    setCarryFlag(A & 0x01);
+    A = (A >> 1) | (oldCarry ? 0x80 : 0x00);
   }
 
-  void syscall_DELAY_US() {
-    // 0x810E - Delay (2*A+6)*12/11.059 microseconds
-    uint32_t us = (2 * A + 6) * 12 / 11;
-    cycleCount += us / 10; // Approximate cycle count
+  void op_DEC_A(const DecodedInstruction &) {
+    A--;
+    updateParity();
   }
 
-  void syscall_DELAY_MS() {
-    // 0x8110 - Delay A milliseconds
-    cycleCount += A * 1000; // ~1000 cycles per ms at 12MHz
+  void op_DEC_direct(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeDataMemory(addr, readDataMemory(addr) - 1);
   }
 
-  void syscall_DELAY_100MS() {
-    // 0x8112 - Delay A * 100 milliseconds
-    cycleCount += A * 100000; // ~100,000 cycles per 100ms
+  void op_DEC_indirect(const DecodedInstruction &insn) {
+    uint8_t reg = insn.opcode & 0x01;
+    writeDataMemory(readRegister(reg), readDataMemory(readRegister(reg)) - 1);
   }
 
-  void syscall_WAIT_ENTER() {
-    // 0x8114 - Display "PRESS ENTER" and wait for ENTER
-    if (!waitingForInput || waitType != WaitType::WaitEnter) {
-      appendOutputString("PRESS ENTER.\n");
-    }
+  template <uint8_t n> void op_DEC_Rn(const DecodedInstruction &) {
+    writeRegister(n, readRegister(n) - 1);
+  }
 
-    std::string line;
-    if (consumeLine(line)) {
-      clearWaitState();
-    } else {
-      setWaitState(WaitType::WaitEnter);
+  // 0x2X - JB, RET, RL, ADD variants
+  void op_JB(const DecodedInstruction &insn) {
+    uint8_t bitAddr = insn.operand1;
+    if (readBit(bitAddr)) {
+      PC = insn.target;
     }
   }
 
-  void syscall_WAIT_ENTER_NW() {
-    // 0x8116 - Wait for ENTER key (no message)
-    std::string line;
-    if (consumeLine(line)) {
-      clearWaitState();
-    } else {
-      setWaitState(WaitType::WaitEnterNW);
-    }
+  void op_RET(const DecodedInstruction &) {
+    PC = (pop() << 8) | pop();
+    returned();
   }
 
-  void syscall_TEST_ENTER() {
-    // 0x8118 - Test if ENTER key is pressed (non-blocking would be ideal)
-    setCarryFlag(false);
+  void op_RL_A(const DecodedInstruction &) { A = (A << 1) | (A >> 7); }
+
+  void add(uint8_t data) {
+    uint16_t result = A + data;
+    recordArithmetic(A, data, result);
+    A = result & 0xFF;
+    updateParity();
   }
 
-  void syscall_WAIT_ENT_ESC() {
-    // 0x811A - Wait for ENTER or ESC
-    char ch;
-    if (!consumeChar(ch)) {
-      setWaitState(WaitType::WaitEnterEsc);
-      return;
+  void op_ADD_imm(const DecodedInstruction &insn) { add(insn.operand1); }
+  void op_ADD_direct(const DecodedInstruction &insn) {
+    add(readDataMemory(insn.operand1));
+  }
+  void op_ADD_indirect(const DecodedInstruction &insn) {
+    add(readDataMemory(readRegister(insn.opcode & 0x01)));
+  }
+  template <uint8_t n> void op_ADD_Rn(const DecodedInstruction &) {
+    add(readRegister(n));
+  }
+
+  // 0x3X - JNB, RETI, RLC, ADDC variants
+  void op_JNB(const DecodedInstruction &insn) {
+    uint8_t bitAddr = insn.operand1;
+    if (!readBit(bitAddr)) {
+      PC = insn.target;
     }
+  }
 
-    clearWaitState();
-    A = static_cast<uint8_t>(ch);
+  void op_RETI(const DecodedInstruction &) {
+    PC = (pop() << 8) | pop();
+    returned();
+    // Ends the interrupt in progress with the highest priority
+    interruptsActive &= interruptsActive & 0x02 ? 0x01 : 0x00;
+    interruptHoldoff = cycleCount + 1;
+    scheduleTimers();
+  }
 
-    if (ch == '\n') {
-      setCarryFlag(false); // ENTER pressed
-    } else if (static_cast<unsigned char>(ch) == 27) {
-      setCarryFlag(true); // ESC pressed
-    }
+  void op_RLC_A(const DecodedInstruction &) {
+    bool oldCarry = getCarryFlag();
+    setCarryFlag(A & 0x80);
+    A = (A << 1) | (oldCarry ? 0x01 : 0x00);
   }
 
-  void syscall_WAIT_KEY() {
-    // 0x811C - Wait for any key (accepts 0-9, a-f/A-F for values 0-15)
-    std::string line;
-    if (!consumeLine(line)) {
-      setWaitState(WaitType::WaitKey);
-      return;
-    }
+  void addc(uint8_t data) {
+    uint16_t result = A + data + (getCarryFlag() ? 1 : 0);
+    recordArithmetic(A, data, result);
+    A = result & 0xFF;
+    updateParity();
+  }
 
-    clearWaitState();
+  void op_ADDC_imm(const DecodedInstruction &insn) { addc(insn.operand1); }
+  void op_ADDC_direct(const DecodedInstruction &insn) {
+    addc(readDataMemory(insn.operand1));
+  }
+  void op_ADDC_indirect(const DecodedInstruction &insn) {
+    addc(readDataMemory(readRegister(insn.opcode & 0x01)));
+  }
+  template <uint8_t n> void op_ADDC_Rn(const DecodedInstruction &) {
+    addc(readRegister(n));
+  }
 
-    if (line.empty()) {
-      A = 0;
-      return;
+  // 0x4X - JC, ORL variants
+  void op_JC(const DecodedInstruction &insn) {
+    if (getCarryFlag()) {
+      PC = insn.target;
     }
+  }
 
-    char ch = line[0];
-    if (ch >= '0' && ch <= '9') {
-      A = ch - '0';
-    } else if (ch >= 'a' && ch <= 'f') {
-      A = 10 + (ch - 'a');
-    } else if (ch >= 'A' && ch <= 'F') {
-      A = 10 + (ch - 'A');
-    } else {
-      A = 0;
-    }
+  void op_ORL_direct_A(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeDataMemory(addr, readDataMemory(addr) | A);
   }
 
-  void syscall_GET_NUM() {
-    // 0x811E - Read BCD number (4 digits)
-    std::string line;
-    if (!consumeLine(line)) {
-      setWaitState(WaitType::GetNum);
-      return;
-    }
+  void op_ORL_direct_imm(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    uint8_t data = insn.operand2;
+    writeDataMemory(addr, readDataMemory(addr) | data);
+  }
 
-    clearWaitState();
+  void op_ORL_A_imm(const DecodedInstruction &insn) {
+    A |= insn.operand1;
+    updateParity();
+  }
 
-    std::istringstream iss(line);
-    std::string token;
-    iss >> token;
+  void op_ORL_A_direct(const DecodedInstruction &insn) {
+    A |= readDataMemory(insn.operand1);
+    updateParity();
+  }
 
-    auto isDigit = [](char ch) {
-      return std::isdigit(static_cast<unsigned char>(ch));
-    };
+  void op_ORL_A_indirect(const DecodedInstruction &insn) {
+    A |= readDataMemory(readRegister(insn.opcode & 0x01));
+    updateParity();
+  }
 
-    if (token.length() >= 4 && isDigit(token[0]) && isDigit(token[1]) &&
-        isDigit(token[2]) && isDigit(token[3])) {
-      uint8_t bank = getRegisterBank();
-      dataMemory[bank * 8 + 3] = ((token[0] - '0') << 4) | (token[1] - '0');
-      dataMemory[bank * 8 + 2] = ((token[2] - '0') << 4) | (token[3] - '0');
+  template <uint8_t n> void op_ORL_A_Rn(const DecodedInstruction &) {
+    A |= readRegister(n);
+    updateParity();
+  }
+
+  // 0x5X - JNC, ANL variants
+  void op_JNC(const DecodedInstruction &insn) {
+    if (!getCarryFlag()) {
+      PC = insn.target;
     }
   }
 
-  void syscall_BCD_HEX() {
-    // 0x8120 - Convert BCD to HEX (R3:R2 -> R3:R2)
-    uint8_t bank = getRegisterBank();
-    uint8_t bcd_high = dataMemory[bank * 8 + 3];
-    uint8_t bcd_low = dataMemory[bank * 8 + 2];
-    uint16_t bcd = (bcd_high << 8) | bcd_low;
+  void op_ANL_direct_A(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeDataMemory(addr, readDataMemory(addr) & A);
+  }
 
-    uint16_t hex = ((bcd >> 12) & 0x0F) * 1000 + ((bcd >> 8) & 0x0F) * 100 +
-                   ((bcd >> 4) & 0x0F) * 10 + (bcd & 0x0F);
+  void op_ANL_direct_imm(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    uint8_t data = insn.operand2;
+    writeDataMemory(addr, readDataMemory(addr) & data);
+  }
 
-    dataMemory[bank * 8 + 3] = hex >> 8;
-    dataMemory[bank * 8 + 2] = hex & 0xFF;
+  void op_ANL_A_imm(const DecodedInstruction &insn) {
+    A &= insn.operand1;
+    updateParity();
   }
 
-  void syscall_HEX_BCD() {
-    // 0x8122 - Convert HEX to BCD (R3:R2 -> R3:R2)
-    uint8_t bank = getRegisterBank();
-    uint16_t hex = (dataMemory[bank * 8 + 3] << 8) | dataMemory[bank * 8 + 2];
+  void op_ANL_A_direct(const DecodedInstruction &insn) {
+    A &= readDataMemory(insn.operand1);
+    updateParity();
+  }
 
-    uint8_t thousands = (hex / 1000) % 10;
-    uint8_t hundreds = (hex / 100) % 10;
-    uint8_t tens = (hex / 10) % 10;
-    uint8_t ones = hex % 10;
+  void op_ANL_A_indirect(const DecodedInstruction &insn) {
+    A &= readDataMemory(readRegister(insn.opcode & 0x01));
+    updateParity();
+  }
 
-    dataMemory[bank * 8 + 3] = (thousands << 4) | hundreds;
-    dataMemory[bank * 8 + 2] = (tens << 4) | ones;
+  template <uint8_t n> void op_ANL_A_Rn(const DecodedInstruction &) {
+    A &= readRegister(n);
+    updateParity();
   }
 
-  void syscall_MUL_2_2() {
-    // 0x8124 - Multiply 2-byte numbers (R3:R2 * R5:R4 -> R7:R6:R5:R4)
-    uint8_t bank = getRegisterBank();
-    uint16_t a = (dataMemory[bank * 8 + 3] << 8) | dataMemory[bank * 8 + 2];
-    uint16_t b = (dataMemory[bank * 8 + 5] << 8) | dataMemory[bank * 8 + 4];
-    uint32_t result = (uint32_t)a * (uint32_t)b;
+  // 0x6X - JZ, XRL variants
+  void op_JZ(const DecodedInstruction &insn) {
+    if (A == 0) {
+      PC = insn.target;
+    }
+  }
 
-    dataMemory[bank * 8 + 7] = (result >> 24) & 0xFF;
-    dataMemory[bank * 8 + 6] = (result >> 16) & 0xFF;
-    dataMemory[bank * 8 + 5] = (result >> 8) & 0xFF;
-    dataMemory[bank * 8 + 4] = result & 0xFF;
+  void op_XRL_direct_A(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeDataMemory(addr, readDataMemory(addr) ^ A);
   }
 
-  void syscall_MUL_3_1() {
-    // 0x8126 - Multiply 3 bytes * 1 byte (R4:R3:R2 * R5 -> R7:R6:R5:R4)
-    uint8_t bank = getRegisterBank();
-    uint32_t a = ((uint32_t)dataMemory[bank * 8 + 4] << 16) |
-                 ((uint32_t)dataMemory[bank * 8 + 3] << 8) |
-                 dataMemory[bank * 8 + 2];
-    uint8_t b = dataMemory[bank * 8 + 5];
-    uint32_t result = a * b;
+  void op_XRL_direct_imm(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    uint8_t data = insn.operand2;
+    writeDataMemory(addr, readDataMemory(addr) ^ data);
+  }
 
-    dataMemory[bank * 8 + 7] = (result >> 24) & 0xFF;
-    dataMemory[bank * 8 + 6] = (result >> 16) & 0xFF;
-    dataMemory[bank * 8 + 5] = (result >> 8) & 0xFF;
-    dataMemory[bank * 8 + 4] = result & 0xFF;
+  void op_XRL_A_imm(const DecodedInstruction &insn) {
+    A ^= insn.operand1;
+    updateParity();
   }
 
-  void syscall_DIV_2_1() {
-    // 0x8128 - Divide 2 bytes / 1 byte (R3:R2 / R4 -> R3:R2 quotient, R5
-    // remainder)
-    uint8_t bank = getRegisterBank();
-    uint16_t dividend =
-        (dataMemory[bank * 8 + 3] << 8) | dataMemory[bank * 8 + 2];
-    uint8_t divisor = dataMemory[bank * 8 + 4];
+  void op_XRL_A_direct(const DecodedInstruction &insn) {
+    A ^= readDataMemory(insn.operand1);
+    updateParity();
+  }
 
-    if (divisor != 0) {
-      uint16_t quotient = dividend / divisor;
-      uint8_t remainder = dividend % divisor;
+  void op_XRL_A_indirect(const DecodedInstruction &insn) {
+    A ^= readDataMemory(readRegister(insn.opcode & 0x01));
+    updateParity();
+  }
 
-      dataMemory[bank * 8 + 3] = quotient >> 8;
-      dataMemory[bank * 8 + 2] = quotient & 0xFF;
-      dataMemory[bank * 8 + 5] = remainder;
-      setOverflowFlag(false);
-    } else {
-      setOverflowFlag(true); // Division by zero
+  template <uint8_t n> void op_XRL_A_Rn(const DecodedInstruction &) {
+    A ^= readRegister(n);
+    updateParity();
+  }
+
+  // 0x7X - JNZ, ORL C, JMP, MOV variants
+  void op_JNZ(const DecodedInstruction &insn) {
+    if (A != 0) {
+      PC = insn.target;
     }
   }
 
-  void syscall_DIV_4_2() {
-    // 0x812A - Divide 4 bytes / 2 bytes (R7:R6:R5:R4 / R3:R2 -> R5:R4 quotient,
-    // R7:R6 remainder)
-    uint8_t bank = getRegisterBank();
-    uint32_t dividend = ((uint32_t)dataMemory[bank * 8 + 7] << 24) |
-                        ((uint32_t)dataMemory[bank * 8 + 6] << 16) |
-                        ((uint32_t)dataMemory[bank * 8 + 5] << 8) |
-                        dataMemory[bank * 8 + 4];
-    uint16_t divisor =
-        (dataMemory[bank * 8 + 3] << 8) | dataMemory[bank * 8 + 2];
+  void op_ORL_C_bit(const DecodedInstruction &insn) {
+    setCarryFlag(getCarryFlag() | readBit(insn.operand1));
+  }
 
-    if (divisor != 0) {
-      uint32_t quotient = dividend / divisor;
-      uint32_t remainder = dividend % divisor;
+  void op_JMP_A_DPTR(const DecodedInstruction &) { PC = A + DPTR; }
 
-      dataMemory[bank * 8 + 5] = (quotient >> 8) & 0xFF;
-      dataMemory[bank * 8 + 4] = quotient & 0xFF;
-      dataMemory[bank * 8 + 7] = (remainder >> 8) & 0xFF;
-      dataMemory[bank * 8 + 6] = remainder & 0xFF;
-      setOverflowFlag(false);
-    } else {
-      setOverflowFlag(true); // Division by zero
-    }
+  void op_MOV_A_imm(const DecodedInstruction &insn) {
+    A = insn.operand1;
+    updateParity();
   }
 
-  void initSystemCalls() {
-    // DSM-51 System Call Addresses (EPROM routines)
-    systemCalls[0x8100] = [this]() { syscall_WRITE_TEXT(); };
-    systemCalls[0x8102] = [this]() { syscall_WRITE_DATA(); };
-    systemCalls[0x8104] = [this]() { syscall_WRITE_HEX(); };
-    systemCalls[0x8106] = [this]() { syscall_WRITE_INSTR(); };
-    systemCalls[0x8108] = [this]() { syscall_LCD_INIT(); };
-    systemCalls[0x810A] = [this]() { syscall_LCD_OFF(); };
-    systemCalls[0x810C] = [this]() { syscall_LCD_CLR(); };
-    systemCalls[0x810E] = [this]() { syscall_DELAY_US(); };
-    systemCalls[0x8110] = [this]() { syscall_DELAY_MS(); };
-    systemCalls[0x8112] = [this]() { syscall_DELAY_100MS(); };
-    systemCalls[0x8114] = [this]() { syscall_WAIT_ENTER(); };
-    systemCalls[0x8116] = [this]() { syscall_WAIT_ENTER_NW(); };
-    systemCalls[0x8118] = [this]() { syscall_TEST_ENTER(); };
-    systemCalls[0x811A] = [this]() { syscall_WAIT_ENT_ESC(); };
-    systemCalls[0x811C] = [this]() { syscall_WAIT_KEY(); };
-    systemCalls[0x811E] = [this]() { syscall_GET_NUM(); };
-    systemCalls[0x8120] = [this]() { syscall_BCD_HEX(); };
-    systemCalls[0x8122] = [this]() { syscall_HEX_BCD(); };
-    systemCalls[0x8124] = [this]() { syscall_MUL_2_2(); };
-    systemCalls[0x8126] = [this]() { syscall_MUL_3_1(); };
-    systemCalls[0x8128] = [this]() { syscall_DIV_2_1(); };
-    systemCalls[0x812A] = [this]() { syscall_DIV_4_2(); };
+  void op_MOV_direct_imm(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    uint8_t data = insn.operand2;
+    writeDataMemory(addr, data);
   }
 
-  SystemCallResult handleSystemCall(uint16_t address) {
-    auto it = systemCalls.find(address);
-    if (it != systemCalls.end()) {
-      it->second(); // Execute the system call
-      if (waitingForInput) {
-        return SystemCallResult::Pending;
-      }
-      return SystemCallResult::Handled;
+  void op_MOV_indirect_imm(const DecodedInstruction &insn) {
+    writeDataMemory(readRegister(insn.opcode & 0x01), insn.operand1);
+  }
+
+  template <uint8_t n> void op_MOV_Rn_imm(const DecodedInstruction &insn) {
+    writeRegister(n, insn.operand1);
+  }
+
+  // 0x8X - SJMP, ANL C, MOVC, DIV, MOV variants
+  void op_SJMP(const DecodedInstruction &insn) { jumpTo(insn); }
+
+  void op_ANL_C_bit(const DecodedInstruction &insn) {
+    setCarryFlag(getCarryFlag() & readBit(insn.operand1));
+  }
+
+  void op_MOVC_A_PC(const DecodedInstruction &) {
+    A = programMemory[(A + PC) & 0xFFFF];
+    updateParity();
+  }
+
+  void op_DIV_AB(const DecodedInstruction &) {
+    if (B == 0) {
+      setOverflowFlag(true);
+      setCarryFlag(false);
+    } else {
+      uint8_t quotient = A / B;
+      uint8_t remainder = A % B;
+      A = quotient;
+      B = remainder;
+      setOverflowFlag(false);
+      setCarryFlag(false);
     }
-    return SystemCallResult::NotHandled;
+    updateParity();
   }
 
-public:
-  Intel8051()
-      : P0(dataMemory[0x80]), P1(dataMemory[0x90]), P2(dataMemory[0xA0]),
-        P3(dataMemory[0xB0]), IE(dataMemory[0xA8]), IP(dataMemory[0xB8]),
-        TMOD(dataMemory[0x89]), TCON(dataMemory[0x88]), TH0(dataMemory[0x8C]),
-        TL0(dataMemory[0x8A]), TH1(dataMemory[0x8D]), TL1(dataMemory[0x8B]),
-        SCON(dataMemory[0x98]), SBUF(dataMemory[0x99]), PCON(dataMemory[0x87]),
-        running(false), cycleCount(0), captureOutput(false), mirrorStdout(true),
-        waitingForInput(false), waitType(WaitType::None) {
-    reset();
+  void op_MOV_direct_direct(const DecodedInstruction &insn) {
+    uint8_t src = insn.operand1;
+    uint8_t dst = insn.operand2;
+    writeDataMemory(dst, readDataMemory(src));
   }
 
-  void reset() {
-    memset(programMemory, 0, sizeof(programMemory));
-    memset(dataMemory, 0, sizeof(dataMemory));
-    memset(externalRAM, 0, sizeof(externalRAM));
+  void op_MOV_direct_indirect(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeDataMemory(addr, readDataMemory(readRegister(insn.opcode & 0x01)));
+  }
 
-    A = 0;
-    B = 0;
-    DPTR = 0;
-    SP = 0x07; // Stack pointer starts at 0x07
-    PC = 0;
-    PSW = 0;
+  template <uint8_t n> void op_MOV_direct_Rn(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeDataMemory(addr, readRegister(n));
+  }
 
-    // Sync registers to their SFR addresses
-    dataMemory[0xE0] = A;           // ACC
-    dataMemory[0xF0] = B;           // B
-    dataMemory[0xD0] = PSW;         // PSW
-    dataMemory[0x81] = SP;          // SP
-    dataMemory[0x82] = DPTR & 0xFF; // DPL
-    dataMemory[0x83] = DPTR >> 8;   // DPH
+  // 0x9X - MOV DPTR, MOVC, SUBB variants
+  void op_MOV_DPTR_imm(const DecodedInstruction &insn) {
+    uint8_t high = insn.operand1;
+    uint8_t low = insn.operand2;
+    DPTR = (high << 8) | low;
+  }
 
-    P0 = P1 = P2 = P3 = 0xFF; // Ports default to high
+  void op_MOV_bit_C(const DecodedInstruction &insn) {
+    uint8_t bitAddr = insn.operand1;
+    writeBit(bitAddr, getCarryFlag());
+  }
 
-    running = false;
-    cycleCount = 0;
+  void op_MOVC_A_DPTR(const DecodedInstruction &) {
+    A = programMemory[(A + DPTR) & 0xFFFF];
+    updateParity();
+  }
 
-    inputBuffer.clear();
-    outputBuffer.clear();
-    clearWaitState();
+  void subb(uint8_t data) {
+    int carry = getCarryFlag() ? 1 : 0;
+    int result = A - data - carry;
+    recordArithmetic(A, data, static_cast<uint16_t>(result));
+    A = result & 0xFF;
+    updateParity();
+  }
 
-    // Initialize system calls for dsm-51 compatibility
-    initSystemCalls();
+  void op_SUBB_imm(const DecodedInstruction &insn) { subb(insn.operand1); }
+  void op_SUBB_direct(const DecodedInstruction &insn) {
+    subb(readDataMemory(insn.operand1));
+  }
+  void op_SUBB_indirect(const DecodedInstruction &insn) {
+    subb(readDataMemory(readRegister(insn.opcode & 0x01)));
+  }
+  template <uint8_t n> void op_SUBB_Rn(const DecodedInstruction &) {
+    subb(readRegister(n));
   }
 
-  bool loadHexFromString(const std::string &hexData) {
-    std::istringstream stream(hexData);
-    return loadHexStream(stream, false, "string input");
+  // 0xAX - ORL C, MOV variants, INC DPTR, MUL
+  void op_ORL_C_nbit(const DecodedInstruction &insn) {
+    setCarryFlag(getCarryFlag() | !readBit(insn.operand1));
   }
 
-  bool loadHexFile(const std::string &filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-      std::cerr << "Error: Could not open file " << filename << std::endl;
-      return false;
-    }
+  void op_MOV_C_bit(const DecodedInstruction &insn) {
+    setCarryFlag(readBit(insn.operand1));
+  }
 
-    bool result = loadHexStream(file, true, filename);
-    file.close();
-    return result;
+  void op_INC_DPTR(const DecodedInstruction &) { DPTR++; }
+
+  void op_MUL_AB(const DecodedInstruction &) {
+    uint16_t result = (uint16_t)A * (uint16_t)B;
+    A = result & 0xFF;
+    B = (result >> 8) & 0xFF;
+    setCarryFlag(false);
+    setOverflowFlag(B != 0);
+    updateParity();
   }
 
-  void setOutputOptions(bool capture, bool mirror) {
-    captureOutput = capture;
-    mirrorStdout = mirror;
-    if (!captureOutput) {
-      outputBuffer.clear();
-    }
+  void op_reserved(const DecodedInstruction &) {
+    std::cerr << "Warning: Undefined opcode 0xA5 at PC=0x" << std::hex
+              << std::setw(4) << std::setfill('0') << (PC - 1) << std::dec
+              << std::endl;
   }
 
-  size_t readOutput(char *buffer, size_t maxLen) {
-    if (!buffer || maxLen == 0) {
-      return 0;
-    }
+  void op_MOV_indirect_direct(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeDataMemory(readRegister(insn.opcode & 0x01), readDataMemory(addr));
+  }
 
-    size_t count = 0;
-    while (count < maxLen && !outputBuffer.empty()) {
-      buffer[count++] = outputBuffer.front();
-      outputBuffer.pop_front();
-    }
-    return count;
+  template <uint8_t n> void op_MOV_Rn_direct(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeRegister(n, readDataMemory(addr));
   }
 
-  std::string readOutputString() {
-    std::string result(outputBuffer.begin(), outputBuffer.end());
-    outputBuffer.clear();
-    return result;
+  // 0xBX - ANL C, CPL variants, CJNE variants
+  void op_ANL_C_nbit(const DecodedInstruction &insn) {
+    setCarryFlag(getCarryFlag() & !readBit(insn.operand1));
   }
 
-  size_t getOutputSize() const { return outputBuffer.size(); }
+  void op_CPL_bit(const DecodedInstruction &insn) {
+    uint8_t bitAddr = insn.operand1;
+    writeBit(bitAddr, !readBit(bitAddr));
+  }
 
-  void clearOutputBuffer() { outputBuffer.clear(); }
+  void op_CPL_C(const DecodedInstruction &) { setCarryFlag(!getCarryFlag()); }
 
-  void pushInput(const char *data, size_t length) {
-    if (!data) {
-      return;
-    }
-    for (size_t i = 0; i < length; ++i) {
-      char ch = data[i];
-      if (ch == '\r') {
-        continue;
-      }
-      inputBuffer.push_back(ch);
+  void cjne(uint8_t val, uint8_t data, uint16_t target) {
+    setCarryFlag(val < data);
+    if (val != data) {
+      PC = target;
     }
   }
 
-  void pushInput(const std::string &text) {
-    pushInput(text.data(), text.size());
+  void op_CJNE_A_imm(const DecodedInstruction &insn) {
+    uint8_t data = insn.operand1;
+    cjne(A, data, insn.target);
   }
 
-  bool isWaitingForInput() const { return waitingForInput; }
-
-  int getWaitTypeCode() const { return static_cast<int>(waitType); }
+  void op_CJNE_A_direct(const DecodedInstruction &insn) {
+    uint8_t data = readDataMemory(insn.operand1);
+    cjne(A, data, insn.target);
+  }
 
-  void getStateSnapshot(EmulatorState &state) const {
-    state.cycles = cycleCount;
-    state.pc = PC;
-    state.dptr = DPTR;
-    state.sp = SP;
-    state.a = A;
-    state.b = B;
-    state.psw = PSW;
-    state.p0 = P0;
-    state.p1 = P1;
-    state.p2 = P2;
-    state.p3 = P3;
+  void op_CJNE_indirect_imm(const DecodedInstruction &insn) {
+    uint8_t val = readDataMemory(readRegister(insn.opcode & 0x01));
+    uint8_t data = insn.operand1;
+    cjne(val, data, insn.target);
   }
 
-  // Read a byte from memory (for external access)
-  uint8_t readMemoryByte(size_t offset) const {
-    if (offset < 256) {
-      // Internal RAM (0x00-0xFF)
-      // Note: readDataMemory is private and does SFR mapping, so directly
-      // access dataMemory But we need to handle SFR registers properly
-      uint8_t addr = static_cast<uint8_t>(offset);
-      if (addr == 0xE0) {
-        return A; // Accumulator
-      } else if (addr == 0xF0) {
-        return B; // B register
-      } else if (addr == 0xD0) {
-        return PSW; // PSW
-      } else if (addr == 0x81) {
-        return SP; // Stack Pointer
-      } else if (addr == 0x82) {
-        return DPTR & 0xFF; // DPL
-      } else if (addr == 0x83) {
-        return DPTR >> 8; // DPH
-      }
-      return dataMemory[addr];
-    } else {
-      // External RAM (256+)
-      uint16_t extAddr = static_cast<uint16_t>(offset - 256);
-      return externalRAM[extAddr];
-    }
+  template <uint8_t n> void op_CJNE_Rn_imm(const DecodedInstruction &insn) {
+    uint8_t val = readRegister(n);
+    uint8_t data = insn.operand1;
+    cjne(val, data, insn.target);
   }
 
-  void executeInstruction() {
-    uint8_t opcode = fetch();
+  // 0xCX - PUSH, CLR, SWAP, XCH variants
+  void op_PUSH(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    push(readDataMemory(addr));
+  }
 
-    switch (opcode) {
-    // 0x0X - NOP, AJMP, LJMP, RR, INC variants
-    case 0x00: // NOP
-      cycleCount += 1;
-      break;
+  void op_CLR_bit(const DecodedInstruction &insn) {
+    uint8_t bitAddr = insn.operand1;
+    writeBit(bitAddr, false);
+  }
 
-    case 0x01:
-    case 0x21:
-    case 0x41:
-    case 0x61:
-    case 0x81:
-    case 0xA1:
-    case 0xC1:
-    case 0xE1: // AJMP addr11
-    {
-      uint8_t addr_low = fetch();
-      uint16_t addr11 = ((opcode & 0xE0) << 3) | addr_low;
-      PC = (PC & 0xF800) | addr11;
-      cycleCount += 2;
-      break;
-    }
+  void op_CLR_C(const DecodedInstruction &) { setCarryFlag(false); }
 
-    case 0x02: // LJMP addr16
-    {
-      uint8_t high = fetch();
-      uint8_t low = fetch();
-      PC = (high << 8) | low;
-      cycleCount += 2;
-      break;
-    }
+  void op_SWAP_A(const DecodedInstruction &) {
+    A = ((A & 0x0F) << 4) | ((A & 0xF0) >> 4);
+    updateParity();
+  }
 
-    case 0x03: // RR A
-      A = (A >> 1) | (A << 7);
-      cycleCount += 1;
-      break;
+  void op_XCH_A_direct(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    uint8_t temp = A;
+    A = readDataMemory(addr);
+    writeDataMemory(addr, temp);
+    updateParity();
+  }
 
-    case 0x04: // INC A
-      A++;
-      updateParity();
-      cycleCount += 1;
-      break;
+  void op_XCH_A_indirect(const DecodedInstruction &insn) {
+    uint8_t reg = insn.opcode & 0x01;
+    uint8_t temp = A;
+    A = readDataMemory(readRegister(reg));
+    writeDataMemory(readRegister(reg), temp);
+    updateParity();
+  }
 
-    case 0x05: // INC direct
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(addr, readDataMemory(addr) + 1);
-      cycleCount += 1;
-      break;
-    }
+  template <uint8_t n> void op_XCH_A_Rn(const DecodedInstruction &) {
+    uint8_t temp = A;
+    A = readRegister(n);
+    writeRegister(n, temp);
+    updateParity();
+  }
 
-    case 0x06: // INC @R0
-      writeDataMemory(readRegister(0), readDataMemory(readRegister(0)) + 1);
-      cycleCount += 1;
-      break;
+  // 0xDX - POP, SETB, DA, DJNZ, XCHD variants
+  void op_POP(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeDataMemory(addr, pop());
+  }
 
-    case 0x07: // INC @R1
-      writeDataMemory(readRegister(1), readDataMemory(readRegister(1)) + 1);
-      cycleCount += 1;
-      break;
+  void op_SETB_bit(const DecodedInstruction &insn) {
+    uint8_t bitAddr = insn.operand1;
+    writeBit(bitAddr, true);
+  }
 
-    case 0x08:
-    case 0x09:
-    case 0x0A:
-    case 0x0B:
-    case 0x0C:
-    case 0x0D:
-    case 0x0E:
-    case 0x0F: // INC Rn
-      writeRegister(opcode & 0x07, readRegister(opcode & 0x07) + 1);
-      cycleCount += 1;
-      break;
+  void op_SETB_C(const DecodedInstruction &) { setCarryFlag(true); }
 
-    // 0x1X - JBC, ACALL, LCALL, RRC, DEC variants
-    case 0x10: // JBC bit, rel
-    {
-      uint8_t bitAddr = fetch();
-      int8_t offset = fetch();
-      if (readBit(bitAddr)) {
-        writeBit(bitAddr, false);
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
+  void op_DA_A(const DecodedInstruction &) {
+    // Decimal adjust after addition for BCD arithmetic
+    uint16_t adjusted = decimalAdjust[(getCarryFlag() ? 0x200 : 0) |
+                                      (getAuxCarryFlag() ? 0x100 : 0) | A];
+    A = adjusted & 0xFF;
+    if (adjusted & 0x100) {
+      setCarryFlag(true);
     }
+    updateParity();
+  }
 
-    case 0x11:
-    case 0x31:
-    case 0x51:
-    case 0x71:
-    case 0x91:
-    case 0xB1:
-    case 0xD1:
-    case 0xF1: // ACALL addr11
-    {
-      uint8_t addr_low = fetch();
-      uint16_t addr11 = ((opcode & 0xE0) << 3) | addr_low;
-      uint16_t targetAddr = (PC & 0xF800) | addr11;
-      SystemCallResult callResult = handleSystemCall(targetAddr);
-
-      if (callResult == SystemCallResult::Handled) {
-        cycleCount += 2;
-      } else if (callResult == SystemCallResult::Pending) {
-        PC -= 2; // Re-execute the call instruction once input is available
-        running = false;
-      } else {
-        push(PC & 0xFF);
-        push(PC >> 8);
-        PC = targetAddr;
-        cycleCount += 2;
-      }
-      break;
+  void op_DJNZ_direct(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    uint8_t value = readDataMemory(addr) - 1;
+    if (value != 0 && addr < 0x80 &&
+        insn.target == static_cast<uint16_t>(PC - 3)) {
+      value -= fastForward(insn, value); // DJNZ direct, $ on plain iRAM
     }
+    writeDataMemory(addr, value);
+    if (value != 0) {
+      PC = insn.target;
+    }
+  }
 
-    case 0x12: // LCALL addr16
-    {
-      uint8_t high = fetch();
-      uint8_t low = fetch();
-      uint16_t targetAddr = (high << 8) | low;
-      SystemCallResult callResult = handleSystemCall(targetAddr);
+  void op_XCHD_A_indirect(const DecodedInstruction &insn) {
+    uint8_t addr = readRegister(insn.opcode & 0x01);
+    uint8_t temp = A & 0x0F;
+    A = (A & 0xF0) | (readDataMemory(addr) & 0x0F);
+    writeDataMemory(addr, (readDataMemory(addr) & 0xF0) | temp);
+    updateParity();
+  }
 
-      if (callResult == SystemCallResult::Handled) {
-        cycleCount += 2;
-      } else if (callResult == SystemCallResult::Pending) {
-        PC -= 3; // Re-execute the call instruction once input is available
-        running = false;
-      } else {
-        push(PC & 0xFF);
-        push(PC >> 8);
-        PC = targetAddr;
-        cycleCount += 2;
-      }
-      break;
+  template <uint8_t n> void op_DJNZ_Rn(const DecodedInstruction &insn) {
+    uint8_t val = readRegister(n) - 1;
+    if (val != 0 && insn.target == static_cast<uint16_t>(PC - 2)) {
+      val -= fastForward(insn, val); // DJNZ Rn, $
     }
-
-    case 0x13: // RRC A
-    {
-      bool oldCarry = getCarryFlag();
-      setCarryFlag(A & 0x01);
-      A = (A >> 1) | (oldCarry ? 0x80 : 0x00);
-      cycleCount += 1;
-      break;
+    writeRegister(n, val);
+    if (val != 0) {
+      PC = insn.target;
     }
+  }
 
-    case 0x14: // DEC A
-      A--;
-      updateParity();
-      cycleCount += 1;
-      break;
+  // 0xEX - MOVX, CLR A, MOV variants
+  void op_MOVX_A_DPTR(const DecodedInstruction &) {
+    A = readExternalRAM(DPTR);
+    updateParity();
+  }
 
-    case 0x15: // DEC direct
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(addr, readDataMemory(addr) - 1);
-      cycleCount += 1;
-      break;
-    }
+  void op_MOVX_A_indirect(const DecodedInstruction &insn) {
+    A = readExternalRAM(readRegister(insn.opcode & 0x01));
+    updateParity();
+  }
 
-    case 0x16: // DEC @R0
-      writeDataMemory(readRegister(0), readDataMemory(readRegister(0)) - 1);
-      cycleCount += 1;
-      break;
+  void op_CLR_A(const DecodedInstruction &) {
+    A = 0;
+    updateParity();
+  }
 
-    case 0x17: // DEC @R1
-      writeDataMemory(readRegister(1), readDataMemory(readRegister(1)) - 1);
-      cycleCount += 1;
-      break;
+  void op_MOV_A_direct(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    A = readDataMemory(addr);
+    updateParity();
+  }
 
-    case 0x18:
-    case 0x19:
-    case 0x1A:
-    case 0x1B:
-    case 0x1C:
-    case 0x1D:
-    case 0x1E:
-    case 0x1F: // DEC Rn
-      writeRegister(opcode & 0x07, readRegister(opcode & 0x07) - 1);
-      cycleCount += 1;
-      break;
+  void op_MOV_A_indirect(const DecodedInstruction &insn) {
+    A = readDataMemory(readRegister(insn.opcode & 0x01));
+    updateParity();
+  }
 
-    // 0x2X - JB, RET, RL, ADD variants
-    case 0x20: // JB bit, rel
-    {
-      uint8_t bitAddr = fetch();
-      int8_t offset = fetch();
-      if (readBit(bitAddr)) {
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
-    }
+  template <uint8_t n> void op_MOV_A_Rn(const DecodedInstruction &) {
+    A = readRegister(n);
+    updateParity();
+  }
 
-    case 0x22: // RET
-      PC = (pop() << 8) | pop();
-      cycleCount += 2;
-      break;
+  // 0xFX - MOVX, CPL A, MOV variants
+  void op_MOVX_DPTR_A(const DecodedInstruction &) { writeExternalRAM(DPTR, A); }
 
-    case 0x23: // RL A
-      A = (A << 1) | (A >> 7);
-      cycleCount += 1;
-      break;
+  void op_MOVX_indirect_A(const DecodedInstruction &insn) {
+    writeExternalRAM(readRegister(insn.opcode & 0x01), A);
+  }
 
-    case 0x24: // ADD A, #data
-    {
-      uint8_t data = fetch();
-      uint16_t result = A + data;
-      setCarryFlag(result > 0xFF);
-      setAuxCarryFlag(((A & 0x0F) + (data & 0x0F)) > 0x0F);
-      setOverflowFlag(((A ^ result) & (data ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
-    }
+  void op_CPL_A(const DecodedInstruction &) {
+    A = ~A;
+    updateParity();
+  }
 
-    case 0x25: // ADD A, direct
-    {
-      uint8_t addr = fetch();
-      uint8_t data = readDataMemory(addr);
-      uint16_t result = A + data;
-      setCarryFlag(result > 0xFF);
-      setAuxCarryFlag(((A & 0x0F) + (data & 0x0F)) > 0x0F);
-      setOverflowFlag(((A ^ result) & (data ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
-    }
+  void op_MOV_direct_A(const DecodedInstruction &insn) {
+    uint8_t addr = insn.operand1;
+    writeDataMemory(addr, A);
+  }
 
-    case 0x26: // ADD A, @R0
-    {
-      uint8_t data = readDataMemory(readRegister(0));
-      uint16_t result = A + data;
-      setCarryFlag(result > 0xFF);
-      setAuxCarryFlag(((A & 0x0F) + (data & 0x0F)) > 0x0F);
-      setOverflowFlag(((A ^ result) & (data ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
-    }
+  void op_MOV_indirect_A(const DecodedInstruction &insn) {
+    writeDataMemory(readRegister(insn.opcode & 0x01), A);
+  }
 
-    case 0x27: // ADD A, @R1
-    {
-      uint8_t data = readDataMemory(readRegister(1));
-      uint16_t result = A + data;
-      setCarryFlag(result > 0xFF);
-      setAuxCarryFlag(((A & 0x0F) + (data & 0x0F)) > 0x0F);
-      setOverflowFlag(((A ^ result) & (data ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
-    }
+  template <uint8_t n> void op_MOV_Rn_A(const DecodedInstruction &) {
+    writeRegister(n, A);
+  }
 
-    case 0x28:
-    case 0x29:
-    case 0x2A:
-    case 0x2B:
-    case 0x2C:
-    case 0x2D:
-    case 0x2E:
-    case 0x2F: // ADD A, Rn
-    {
-      uint8_t data = readRegister(opcode & 0x07);
-      uint16_t result = A + data;
-      setCarryFlag(result > 0xFF);
-      setAuxCarryFlag(((A & 0x0F) + (data & 0x0F)) > 0x0F);
-      setOverflowFlag(((A ^ result) & (data ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
+  // Destination of a jump or call, worked out once when the instruction is
+  // decoded. next is the address of the following instruction.
+  static uint16_t branchTarget(const DecodedInstruction &insn, uint16_t next) {
+    uint8_t opcode = insn.opcode;
+    if ((opcode & 0x0F) == 0x01) {
+      // AJMP/ACALL addr11
+      return (next & 0xF800) | ((opcode & 0xE0) << 3) | insn.operand1;
     }
-
-    // 0x3X - JNB, RETI, RLC, ADDC variants
-    case 0x30: // JNB bit, rel
-    {
-      uint8_t bitAddr = fetch();
-      int8_t offset = fetch();
-      if (!readBit(bitAddr)) {
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
+    if (opcode == 0x02 || opcode == 0x12) {
+      // LJMP/LCALL addr16
+      return (insn.operand1 << 8) | insn.operand2;
     }
-
-    case 0x32: // RETI
-      PC = (pop() << 8) | pop();
-      // TODO: Clear interrupt-in-progress flag
-      cycleCount += 2;
-      break;
-
-    case 0x33: // RLC A
-    {
-      bool oldCarry = getCarryFlag();
-      setCarryFlag(A & 0x80);
-      A = (A << 1) | (oldCarry ? 0x01 : 0x00);
-      cycleCount += 1;
-      break;
+    if (opcode == 0x40 || opcode == 0x50 || opcode == 0x60 || opcode == 0x70 ||
+        opcode == 0x80 || (opcode & 0xF8) == 0xD8) {
+      // JC, JNC, JZ, JNZ, SJMP, DJNZ Rn - rel is the first operand
+      return next + static_cast<int8_t>(insn.operand1);
     }
-
-    case 0x34: // ADDC A, #data
-    {
-      uint8_t data = fetch();
-      uint16_t result = A + data + (getCarryFlag() ? 1 : 0);
-      setAuxCarryFlag(((A & 0x0F) + (data & 0x0F) + (getCarryFlag() ? 1 : 0)) >
-                      0x0F);
-      setCarryFlag(result > 0xFF);
-      setOverflowFlag(((A ^ result) & (data ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
+    if (opcode == 0x10 || opcode == 0x20 || opcode == 0x30 || opcode == 0xD5 ||
+        (opcode >= 0xB4 && opcode <= 0xBF)) {
+      // JBC, JB, JNB, DJNZ direct, CJNE - rel is the second operand
+      return next + static_cast<int8_t>(insn.operand2);
     }
+    return 0;
+  }
 
-    case 0x35: // ADDC A, direct
-    {
-      uint8_t addr = fetch();
-      uint8_t data = readDataMemory(addr);
-      uint16_t result = A + data + (getCarryFlag() ? 1 : 0);
-      setAuxCarryFlag(((A & 0x0F) + (data & 0x0F) + (getCarryFlag() ? 1 : 0)) >
-                      0x0F);
-      setCarryFlag(result > 0xFF);
-      setOverflowFlag(((A ^ result) & (data ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
-    }
+  void decodeAt(uint16_t addr) {
+    uint8_t opcode = programMemory[addr];
+    DecodedInstruction &insn = decodeCache[addr];
+    insn.handler = opcodeTable[opcode];
+    insn.opcode = opcode;
+    insn.operand1 = programMemory[static_cast<uint16_t>(addr + 1)];
+    insn.operand2 = programMemory[static_cast<uint16_t>(addr + 2)];
+    insn.length = opcodeLengths[opcode];
+    insn.cycles = opcodeCycles[opcode];
+    insn.target = branchTarget(insn, addr + insn.length);
+  }
 
-    case 0x36: // ADDC A, @R0
-    {
-      uint8_t data = readDataMemory(readRegister(0));
-      uint16_t result = A + data + (getCarryFlag() ? 1 : 0);
-      setAuxCarryFlag(((A & 0x0F) + (data & 0x0F) + (getCarryFlag() ? 1 : 0)) >
-                      0x0F);
-      setCarryFlag(result > 0xFF);
-      setOverflowFlag(((A ^ result) & (data ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
+  // Brings the decode cache in line with programMemory. Only 256-byte pages
+  // whose bytes differ from the ones the cache was built from are decoded
+  // again, so reloading the same ROM costs one compare and no decoding.
+  // Translated blocks are dropped whenever anything had to be re-decoded.
+  void refreshDecodeCache() {
+    if (decodeCache.empty()) {
+      decodeCache.resize(sizeof(programMemory));
+      decodedRom.assign(programMemory, programMemory + sizeof(programMemory));
+      for (uint32_t addr = 0; addr < sizeof(programMemory); ++addr) {
+        decodeAt(addr);
+      }
+      flushBlocks();
+    } else {
+      bool changed = false;
+      for (uint32_t base = 0; base < sizeof(programMemory); base += 256) {
+        if (memcmp(&decodedRom[base], &programMemory[base], 256) == 0) {
+          continue;
+        }
+        memcpy(&decodedRom[base], &programMemory[base], 256);
+        // The last two entries of the previous page read operands from here
+        for (uint32_t i = 0; i < 258; ++i) {
+          decodeAt((base - 2 + i) & 0xFFFF);
+        }
+        changed = true;
+      }
+      if (changed) {
+        flushBlocks();
+      }
     }
+    decodeCacheStale = false;
+  }
 
-    case 0x37: // ADDC A, @R1
-    {
-      uint8_t data = readDataMemory(readRegister(1));
-      uint16_t result = A + data + (getCarryFlag() ? 1 : 0);
-      setAuxCarryFlag(((A & 0x0F) + (data & 0x0F) + (getCarryFlag() ? 1 : 0)) >
-                      0x0F);
-      setCarryFlag(result > 0xFF);
-      setOverflowFlag(((A ^ result) & (data ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
+  void syncDecodeCache() {
+    if (decodeCacheStale) {
+      refreshDecodeCache();
     }
+  }
 
-    case 0x38:
-    case 0x39:
-    case 0x3A:
-    case 0x3B:
-    case 0x3C:
-    case 0x3D:
-    case 0x3E:
-    case 0x3F: // ADDC A, Rn
-    {
-      uint8_t data = readRegister(opcode & 0x07);
-      uint16_t result = A + data + (getCarryFlag() ? 1 : 0);
-      setAuxCarryFlag(((A & 0x0F) + (data & 0x0F) + (getCarryFlag() ? 1 : 0)) >
-                      0x0F);
-      setCarryFlag(result > 0xFF);
-      setOverflowFlag(((A ^ result) & (data ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
+  // Busy-wait loops. An instruction that jumps to itself and changes nothing
+  // but a counter is run again by every engine until endCycle, so the
+  // iterations the current run would still start are charged at once.
+  // Called once the first iteration has run; returns how many more there
+  // are, at most limit.
+  uint64_t fastForward(const DecodedInstruction &insn, uint64_t limit) {
+    if (cycleCount >= endCycle) {
+      return 0;
     }
-
-    // 0x4X - JC, ORL variants
-    case 0x40: // JC rel
-    {
-      int8_t offset = fetch();
-      if (getCarryFlag()) {
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
+    uint64_t iterations = (endCycle - cycleCount - 1) / insn.cycles + 1;
+    if (iterations > limit) {
+      iterations = limit;
     }
+    cycleCount += iterations * insn.cycles;
+    fastForwarded += iterations;
+    return iterations;
+  }
 
-    case 0x42: // ORL direct, A
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(addr, readDataMemory(addr) | A);
-      cycleCount += 1;
-      break;
+  void returned() {
+    if (--callDepth < returnDepth) {
+      stopRun(StopReason::StepComplete);
     }
+  }
 
-    case 0x43: // ORL direct, #data
-    {
-      uint8_t addr = fetch();
-      uint8_t data = fetch();
-      writeDataMemory(addr, readDataMemory(addr) | data);
-      cycleCount += 2;
-      break;
+  // AJMP, LJMP and SJMP. Only an interrupt can leave a jump to itself: the
+  // program idles until the next event. With none coming, the host can
+  // still wake it up with serial input while the receiver and its interrupt
+  // are enabled, so the run waits for that; otherwise the program has
+  // finished and the run stops there.
+  void jumpTo(const DecodedInstruction &insn) {
+    if (insn.target == static_cast<uint16_t>(PC - insn.length)) {
+      if (nextEvent != UINT64_MAX) {
+        fastForward(insn, UINT64_MAX);
+      } else if (canInterrupt(4) && (SCON & 0x10)) {
+        stopRun(StopReason::WaitingForInput);
+      } else {
+        stopRun(StopReason::Halted);
+      }
     }
+    PC = insn.target;
+  }
 
-    case 0x44: // ORL A, #data
-      A |= fetch();
-      updateParity();
-      cycleCount += 1;
-      break;
-
-    case 0x45: // ORL A, direct
-      A |= readDataMemory(fetch());
-      updateParity();
-      cycleCount += 1;
-      break;
-
-    case 0x46: // ORL A, @R0
-      A |= readDataMemory(readRegister(0));
-      updateParity();
-      cycleCount += 1;
-      break;
-
-    case 0x47: // ORL A, @R1
-      A |= readDataMemory(readRegister(1));
-      updateParity();
-      cycleCount += 1;
-      break;
-
-    case 0x48:
-    case 0x49:
-    case 0x4A:
-    case 0x4B:
-    case 0x4C:
-    case 0x4D:
-    case 0x4E:
-    case 0x4F: // ORL A, Rn
-      A |= readRegister(opcode & 0x07);
-      updateParity();
-      cycleCount += 1;
-      break;
+  // Events that are due when the run starts are handled first
+  void beginRun(uint64_t maxCycles) {
+    running = true;
+    stopReason = StopReason::CycleLimit;
+    pollSerialInput();
+    dispatchEvents();
+    runEnd = maxCycles > 0 ? cycleCount + maxCycles : UINT64_MAX;
+    endCycle = std::min(runEnd, nextEvent);
+  }
 
-    // 0x5X - JNC, ANL variants
-    case 0x50: // JNC rel
-    {
-      int8_t offset = fetch();
-      if (!getCarryFlag()) {
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
-    }
+  // Ends the run after the current instruction
+  void stopRun(StopReason reason) {
+    running = false;
+    stopReason = reason;
+  }
 
-    case 0x52: // ANL direct, A
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(addr, readDataMemory(addr) & A);
-      cycleCount += 1;
-      break;
-    }
+  // Moves PC past the instruction it points at and charges its cycles
+  const DecodedInstruction &nextInstruction() {
+    const DecodedInstruction &insn = decodeCache[PC];
+    PC += insn.length;
+    cycleCount += insn.cycles;
+    return insn;
+  }
 
-    case 0x53: // ANL direct, #data
-    {
-      uint8_t addr = fetch();
-      uint8_t data = fetch();
-      writeDataMemory(addr, readDataMemory(addr) & data);
-      cycleCount += 2;
-      break;
+  void dispatchSwitch(const DecodedInstruction &insn) {
+    switch (insn.opcode) {
+#define INTEL8051_CASE(code, handler, length, cycles)                          \
+  case code:                                                                   \
+    handler(insn);                                                             \
+    break;
+      INTEL8051_OPCODES(INTEL8051_CASE)
+#undef INTEL8051_CASE
     }
+  }
 
-    case 0x54: // ANL A, #data
-      A &= fetch();
-      updateParity();
-      cycleCount += 1;
-      break;
-
-    case 0x55: // ANL A, direct
-      A &= readDataMemory(fetch());
-      updateParity();
-      cycleCount += 1;
-      break;
+  void executeSwitch() { dispatchSwitch(nextInstruction()); }
 
-    case 0x56: // ANL A, @R0
-      A &= readDataMemory(readRegister(0));
-      updateParity();
-      cycleCount += 1;
-      break;
+  void executeTable() {
+    const DecodedInstruction &insn = nextInstruction();
+    (this->*insn.handler)(insn);
+  }
 
-    case 0x57: // ANL A, @R1
-      A &= readDataMemory(readRegister(1));
-      updateParity();
-      cycleCount += 1;
-      break;
+#if INTEL8051_HAS_THREADED_DISPATCH
+  // Direct-threaded interpreter: every handler body ends in its own indirect
+  // jump to the next opcode, so there is no shared dispatch branch and no
+  // return to a central loop between instructions.
+  void runThreaded(uint64_t maxCycles) {
+    static void *const labels[256] = {
+#define INTEL8051_LABEL(code, handler, length, cycles) &&threaded_##code,
+        INTEL8051_OPCODES(INTEL8051_LABEL)
+#undef INTEL8051_LABEL
+    };
 
-    case 0x58:
-    case 0x59:
-    case 0x5A:
-    case 0x5B:
-    case 0x5C:
-    case 0x5D:
-    case 0x5E:
-    case 0x5F: // ANL A, Rn
-      A &= readRegister(opcode & 0x07);
-      updateParity();
-      cycleCount += 1;
-      break;
+    beginRun(maxCycles);
+    const DecodedInstruction *insn = &nextInstruction();
+    goto *labels[insn->opcode];
+
+#define INTEL8051_THREAD(code, handler, length, cycles)                        \
+  threaded_##code:                                                             \
+    handler(*insn);                                                            \
+    if (!running || (cycleCount >= endCycle && !continueRun()))                \
+      return;                                                                  \
+    insn = &nextInstruction();                                                 \
+    goto *labels[insn->opcode];
+    INTEL8051_OPCODES(INTEL8051_THREAD)
+#undef INTEL8051_THREAD
+  }
+#endif
 
-    // 0x6X - JZ, XRL variants
-    case 0x60: // JZ rel
-    {
-      int8_t offset = fetch();
-      if (A == 0) {
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
+  // Instructions that may leave the straight-line path end a basic block
+  static bool endsBlock(uint8_t opcode) {
+    switch (opcode) {
+    case 0x02: // LJMP
+    case 0x10: // JBC
+    case 0x12: // LCALL
+    case 0x20: // JB
+    case 0x22: // RET
+    case 0x30: // JNB
+    case 0x32: // RETI
+    case 0x40: // JC
+    case 0x50: // JNC
+    case 0x60: // JZ
+    case 0x70: // JNZ
+    case 0x73: // JMP @A+DPTR
+    case 0x80: // SJMP
+    case 0xD5: // DJNZ direct
+      return true;
+    default:
+      // AJMP/ACALL, CJNE, DJNZ Rn
+      return (opcode & 0x0F) == 0x01 || (opcode >= 0xB4 && opcode <= 0xBF) ||
+             (opcode & 0xF8) == 0xD8;
     }
+  }
 
-    case 0x62: // XRL direct, A
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(addr, readDataMemory(addr) ^ A);
-      cycleCount += 1;
-      break;
+  // INC, DEC, MOV, XCH and XCHD with an @Ri destination
+  static bool writesIndirect(uint8_t opcode) {
+    if ((opcode & 0x0E) != 0x06) {
+      return false;
     }
-
-    case 0x63: // XRL direct, #data
-    {
-      uint8_t addr = fetch();
-      uint8_t data = fetch();
-      writeDataMemory(addr, readDataMemory(addr) ^ data);
-      cycleCount += 2;
-      break;
+    switch (opcode >> 4) {
+    case 0x0: // INC @Ri
+    case 0x1: // DEC @Ri
+    case 0x7: // MOV @Ri, #imm
+    case 0xA: // MOV @Ri, direct
+    case 0xC: // XCH A, @Ri
+    case 0xD: // XCHD A, @Ri
+    case 0xF: // MOV @Ri, A
+      return true;
+    default:
+      return false;
     }
+  }
 
-    case 0x64: // XRL A, #data
-      A ^= fetch();
-      updateParity();
-      cycleCount += 1;
-      break;
+  // Direct address an instruction writes, 0 for none
+  static uint8_t directWriteTarget(const DecodedInstruction &insn) {
+    switch (insn.opcode) {
+    case 0x05: // INC direct
+    case 0x15: // DEC direct
+    case 0x42: // ORL direct, A
+    case 0x43: // ORL direct, #imm
+    case 0x52: // ANL
+    case 0x53:
+    case 0x62: // XRL
+    case 0x63:
+    case 0x75: // MOV direct, #imm
+    case 0x86: // MOV direct, @Ri
+    case 0x87:
+    case 0xC5: // XCH A, direct
+    case 0xD0: // POP
+    case 0xF5: // MOV direct, A
+      return insn.operand1;
+    case 0x85: // MOV direct, direct
+      return insn.operand2;
+    case 0x92: // MOV bit, C
+    case 0xB2: // CPL bit
+    case 0xC2: // CLR bit
+    case 0xD2: // SETB bit
+      return bitByte(insn.operand1);
+    default:
+      return (insn.opcode & 0xF8) == 0x88 ? insn.operand1 : 0; // MOV dir, Rn
+    }
+  }
 
-    case 0x65: // XRL A, direct
-      A ^= readDataMemory(fetch());
-      updateParity();
-      cycleCount += 1;
-      break;
+  // Writes to the SFRs of peripherals with events end a block as well, so
+  // every engine looks for an event they make due right after them
+  static bool endsBlock(const DecodedInstruction &insn) {
+    return endsBlock(insn.opcode) || isEventSfr(directWriteTarget(insn));
+  }
 
-    case 0x66: // XRL A, @R0
-      A ^= readDataMemory(readRegister(0));
-      updateParity();
-      cycleCount += 1;
-      break;
+  void flushBlocks() {
+    blocks.clear();
+    blockCode.clear();
+    blockAt.clear();
+#if INTEL8051_JIT_X86
+    jitCode.clear();
+#elif INTEL8051_JIT_WASM
+    jitReleaseWasm(this);
+#endif
+  }
 
-    case 0x67: // XRL A, @R1
-      A ^= readDataMemory(readRegister(1));
-      updateParity();
-      cycleCount += 1;
-      break;
+  // Translates the instructions starting at start into a new block
+  int32_t buildBlock(uint16_t start) {
+    BasicBlock block;
+    block.first = static_cast<uint32_t>(blockCode.size());
+    block.count = 0;
+    block.cycles = 0;
+    block.start = start;
+    block.nextFallThrough = -1;
+    block.nextTaken = -1;
+    block.writesIndirect = false;
+#if INTEL8051_HAS_JIT
+    block.executions = 0;
+    block.jit = nullptr;
+    block.sideEffects = false;
+    block.loops = false;
+#endif
+
+    uint16_t addr = start;
+    const DecodedInstruction *insn;
+    do {
+      insn = &decodeCache[addr];
+      blockCode.push_back(*insn);
+      block.count++;
+      block.cycles += insn->cycles;
+      block.writesIndirect |= writesIndirect(insn->opcode);
+      addr += insn->length;
+    } while (!endsBlock(*insn) && block.count < maxBlockLength);
+
+    block.fallThrough = addr;
+    block.taken = insn->target;
+
+    int32_t index = static_cast<int32_t>(blocks.size());
+    blocks.push_back(block);
+    blockAt[start] = index;
+    return index;
+  }
 
-    case 0x68:
-    case 0x69:
-    case 0x6A:
-    case 0x6B:
-    case 0x6C:
-    case 0x6D:
-    case 0x6E:
-    case 0x6F: // XRL A, Rn
-      A ^= readRegister(opcode & 0x07);
-      updateParity();
-      cycleCount += 1;
-      break;
+  int32_t lookupBlock(uint16_t addr) {
+    int32_t index = blockAt[addr];
+    return index >= 0 ? index : buildBlock(addr);
+  }
 
-    // 0x7X - JNZ, ORL C, JMP, MOV variants
-    case 0x70: // JNZ rel
-    {
-      int8_t offset = fetch();
-      if (A != 0) {
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
+  // Block to run after the given one. The two static successors are linked
+  // the first time they are taken, so loops go from block to block without a
+  // lookup; returns and computed jumps fall back to the address map.
+  int32_t nextBlock(int32_t index) {
+    const BasicBlock &block = blocks[index];
+    if (PC == block.taken && block.nextTaken >= 0) {
+      return block.nextTaken;
+    }
+    if (PC == block.fallThrough && block.nextFallThrough >= 0) {
+      return block.nextFallThrough;
     }
 
-    case 0x72: // ORL C, bit
-      setCarryFlag(getCarryFlag() | readBit(fetch()));
-      cycleCount += 2;
-      break;
+    bool taken = PC == block.taken;
+    bool fallThrough = PC == block.fallThrough;
+    int32_t next = lookupBlock(PC); // May grow blocks
+    if (taken) {
+      blocks[index].nextTaken = next;
+    }
+    if (fallThrough) {
+      blocks[index].nextFallThrough = next;
+    }
+    return next;
+  }
 
-    case 0x73: // JMP @A+DPTR
-      PC = A + DPTR;
-      cycleCount += 2;
-      break;
+  // Charges each instruction's cycles before its handler runs, as the other
+  // engines do, so the timers read the same cycle count everywhere. Stops
+  // early when a store through @Ri moves endCycle into the rest of the
+  // block, see jitInterpret().
+  void executeBlock(const BasicBlock &block) {
+    const uint64_t blockEnd = cycleCount + block.cycles;
+    const bool checkEnd = block.writesIndirect;
+    const DecodedInstruction *insn = &blockCode[block.first];
+    const DecodedInstruction *end = insn + block.count;
+    for (; insn != end; ++insn) {
+      PC += insn->length;
+      cycleCount += insn->cycles;
+      dispatchSwitch(*insn);
+      if (checkEnd && blockEnd > endCycle) {
+        return;
+      }
+    }
+  }
 
-    case 0x74: // MOV A, #data
-      A = fetch();
-      updateParity();
-      cycleCount += 1;
-      break;
+#if INTEL8051_HAS_JIT
+  // Entry point for instructions the JIT leaves to the interpreter. The
+  // decoded instruction travels packed into one register, along with the
+  // cycles of the rest of the block: translated code charges the whole
+  // block on entry, and the handler should see only those up to its own
+  // instruction.
+  static uint64_t packInstruction(const DecodedInstruction &insn,
+                                  uint32_t later) {
+    return insn.opcode | (insn.operand1 << 8) | (insn.operand2 << 16) |
+           (static_cast<uint64_t>(insn.target) << 24) |
+           (static_cast<uint64_t>(insn.length) << 40) |
+           (static_cast<uint64_t>(insn.cycles) << 48) |
+           (static_cast<uint64_t>(later) << 56);
+  }
 
-    case 0x75: // MOV direct, #data
-    {
-      uint8_t addr = fetch();
-      uint8_t data = fetch();
-      writeDataMemory(addr, data);
-      cycleCount += 2;
-      break;
+  // Returns true when the handler has moved endCycle into the rest of the
+  // block, say by enabling an interrupt through @Ri. The translated code
+  // then leaves the block with only this instruction charged, and the run
+  // loop takes it from there.
+  static bool jitInterpret(Intel8051 *cpu, uint64_t packed) {
+    DecodedInstruction insn;
+    insn.opcode = packed & 0xFF;
+    insn.operand1 = (packed >> 8) & 0xFF;
+    insn.operand2 = (packed >> 16) & 0xFF;
+    insn.target = (packed >> 24) & 0xFFFF;
+    insn.length = (packed >> 40) & 0xFF;
+    insn.cycles = (packed >> 48) & 0xFF;
+    insn.handler = opcodeTable[insn.opcode];
+    uint64_t later = packed >> 56;
+    cpu->cycleCount -= later;
+    cpu->dispatchSwitch(insn);
+    cpu->syncFlags(); // Translated code reads and writes PSW directly
+    if (later > 0 && cpu->cycleCount + later > cpu->endCycle) {
+      return true;
     }
+    cpu->cycleCount += later;
+    return false;
+  }
 
-    case 0x76: // MOV @R0, #data
-      writeDataMemory(readRegister(0), fetch());
-      cycleCount += 1;
-      break;
+  // Blocks ending in a DJNZ or jump to itself stay on the interpreter, which
+  // fast-forwards the loop or halts on it (see fastForward() and jumpTo())
+  bool endsInSelfLoop(const BasicBlock &block) const {
+    const DecodedInstruction &last = blockCode[block.first + block.count - 1];
+    uint8_t opcode = last.opcode;
+    return last.target ==
+               static_cast<uint16_t>(block.fallThrough - last.length) &&
+           (opcode == 0x02 || opcode == 0x80 || opcode == 0xD5 ||
+            (opcode & 0x1F) == 0x01 || (opcode & 0xF8) == 0xD8);
+  }
 
-    case 0x77: // MOV @R1, #data
-      writeDataMemory(readRegister(1), fetch());
-      cycleCount += 1;
-      break;
+  int32_t offsetInCpu(const void *member) const {
+    return static_cast<int32_t>(static_cast<const uint8_t *>(member) -
+                                reinterpret_cast<const uint8_t *>(this));
+  }
 
-    case 0x78:
-    case 0x79:
-    case 0x7A:
-    case 0x7B:
-    case 0x7C:
-    case 0x7D:
-    case 0x7E:
-    case 0x7F: // MOV Rn, #data
-      writeRegister(opcode & 0x07, fetch());
-      cycleCount += 1;
-      break;
+  // Interpreted instructions that lockstep verification must not replay:
+  // calls (system calls do I/O), MOVX (devices in the MOVX space), the
+  // undefined opcode warning and writes to SCON or SBUF, which exchange
+  // bytes with the host
+  static bool hasSideEffects(const DecodedInstruction &insn) {
+    uint8_t opcode = insn.opcode;
+    uint8_t target =
+        opcode == 0x10 ? bitByte(insn.operand1) : directWriteTarget(insn);
+    return (opcode & 0x1F) == 0x11 || opcode == 0x12 || opcode == 0xA5 ||
+           (opcode & 0xEF) == 0xE0 || (opcode & 0xEE) == 0xE2 || // MOVX
+           (target & 0xCF) == 0x80 || // P0-P3
+           target == 0x98 || target == 0x99;
+  }
 
-    // 0x8X - SJMP, ANL C, MOVC, DIV, MOV variants
-    case 0x80: // SJMP rel
-    {
-      int8_t offset = fetch();
-      PC += offset;
-      cycleCount += 2;
-      break;
-    }
+#if INTEL8051_JIT_X86
+  // Register bank base into eax, for X86Emitter::bankMem
+  void emitLoadBank(X86Emitter &x) {
+    x.mem({0x0F, 0xB6}, X86Emitter::AL, offsetInCpu(&registerBankBase));
+  }
 
-    case 0x82: // ANL C, bit
-      setCarryFlag(getCarryFlag() & readBit(fetch()));
-      cycleCount += 2;
-      break;
+  // A = al, with P evaluated right away (see updateParity())
+  void emitStoreA(X86Emitter &x) {
+    x.mem({0x88}, X86Emitter::AL, offsetInCpu(&A));
+    x.emit({0x84, 0xC0});                                   // test al, al
+    x.emit({0x0F, 0x9B, 0xC1});                             // setnp cl
+    x.mem({0x0F, 0xB6}, X86Emitter::DL, offsetInCpu(&PSW)); // movzx edx
+    x.emit({0x80, 0xE2, 0xFE});                             // and dl, 0xFE
+    x.emit({0x08, 0xCA});                                   // or dl, cl
+    x.mem({0x88}, X86Emitter::DL, offsetInCpu(&PSW));
+  }
 
-    case 0x83: // MOVC A, @A+PC
-      A = programMemory[(A + PC) & 0xFFFF];
-      updateParity();
-      cycleCount += 2;
-      break;
+  // Carry flag = cl (0 or 1), as setCarryFlag() does
+  void emitStoreCarry(X86Emitter &x) {
+    x.emit({0xC0, 0xE1, 0x07});                             // shl cl, 7
+    x.mem({0x0F, 0xB6}, X86Emitter::DL, offsetInCpu(&PSW)); // movzx edx
+    x.emit({0x80, 0xE2, 0x7F});                             // and dl, 0x7F
+    x.emit({0x08, 0xCA});                                   // or dl, cl
+    x.mem({0x88}, X86Emitter::DL, offsetInCpu(&PSW));
+  }
 
-    case 0x84: // DIV AB
-      if (B == 0) {
-        setOverflowFlag(true);
-        setCarryFlag(false);
-      } else {
-        uint8_t quotient = A / B;
-        uint8_t remainder = A % B;
-        A = quotient;
-        B = remainder;
-        // Sync back to memory
-        dataMemory[0xE0] = A;
-        dataMemory[0xF0] = B;
-        setOverflowFlag(false);
-        setCarryFlag(false);
-      }
-      updateParity();
-      cycleCount += 4;
-      break;
+  // CJNE on the value in al: carry = al < data, zero flag clear if they differ
+  void emitCompareJump(X86Emitter &x, uint8_t data) {
+    x.emit({0x3C, data});       // cmp al, imm8
+    x.emit({0x0F, 0x92, 0xC1}); // setb cl
+    x.emit({0x0F, 0x95, 0xC0}); // setne al
+    emitStoreCarry(x);
+    x.emit({0x84, 0xC0}); // test al, al
+  }
 
-    case 0x85: // MOV direct, direct
-    {
-      uint8_t src = fetch();
-      uint8_t dst = fetch();
-      writeDataMemory(dst, readDataMemory(src));
-      cycleCount += 2;
-      break;
-    }
+  void emitSetPC(X86Emitter &x, uint16_t value) {
+    x.mem({0x66, 0xC7}, 0, offsetInCpu(&PC));
+    x.imm16(value);
+  }
 
-    case 0x86: // MOV direct, @R0
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(addr, readDataMemory(readRegister(0)));
-      cycleCount += 2;
-      break;
+  // Emits native code for insn when it only touches registers, plain
+  // internal RAM below 0x80 and PSW flags. Branches leave their condition in
+  // the zero flag and set taken to the jcc opcode byte that skips the branch.
+  // Returns false for anything the interpreter has to run, in particular SFR
+  // accesses, calls (system calls) and MOVX.
+  bool emitNative(X86Emitter &x, const DecodedInstruction &insn,
+                  uint8_t &skipBranch) {
+    const int32_t data = offsetInCpu(dataMemory);
+    const uint8_t opcode = insn.opcode;
+    const uint8_t reg = opcode & 0x07;
+    const bool lowDirect = insn.operand1 < 0x80;
+    skipBranch = 0;
+
+    if (opcode == 0x00) { // NOP
+      return true;
     }
-
-    case 0x87: // MOV direct, @R1
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(addr, readDataMemory(readRegister(1)));
-      cycleCount += 2;
-      break;
+    if (opcode == 0x02 || opcode == 0x80 || (opcode & 0x1F) == 0x01) {
+      skipBranch = 0xFF; // LJMP, SJMP, AJMP: always taken
+      return true;
+    }
+    switch (opcode) {
+    case 0x04: // INC A
+      x.mem({0x0F, 0xB6}, X86Emitter::AL, offsetInCpu(&A));
+      x.emit({0x04, 0x01}); // add al, 1
+      emitStoreA(x);
+      return true;
+    case 0x14: // DEC A
+      x.mem({0x0F, 0xB6}, X86Emitter::AL, offsetInCpu(&A));
+      x.emit({0x2C, 0x01}); // sub al, 1
+      emitStoreA(x);
+      return true;
+    case 0x74: // MOV A, #imm
+    case 0xE4: // CLR A
+      x.imm8(0xB0); // mov al, imm8
+      x.imm8(opcode == 0xE4 ? 0 : insn.operand1);
+      emitStoreA(x);
+      return true;
+    case 0xE5: // MOV A, direct
+      if (!lowDirect) {
+        return false;
+      }
+      x.mem({0x0F, 0xB6}, X86Emitter::AL, data + insn.operand1);
+      emitStoreA(x);
+      return true;
+    case 0x75: // MOV direct, #imm
+      if (!lowDirect) {
+        return false;
+      }
+      x.mem({0xC6}, 0, data + insn.operand1);
+      x.imm8(insn.operand2);
+      return true;
+    case 0xF5: // MOV direct, A
+      if (!lowDirect) {
+        return false;
+      }
+      x.mem({0x0F, 0xB6}, X86Emitter::CL, offsetInCpu(&A));
+      x.mem({0x88}, X86Emitter::CL, data + insn.operand1);
+      return true;
+    case 0xC3: // CLR C
+    case 0xD3: // SETB C
+      x.emit({0xB1, static_cast<uint8_t>(opcode == 0xD3)}); // mov cl, imm8
+      emitStoreCarry(x);
+      return true;
+    case 0x40: // JC
+    case 0x50: // JNC
+      x.mem({0x0F, 0xB6}, X86Emitter::AL, offsetInCpu(&PSW));
+      x.emit({0xA8, 0x80}); // test al, 0x80
+      skipBranch = opcode == 0x40 ? 0x84 : 0x85;
+      return true;
+    case 0x60: // JZ
+    case 0x70: // JNZ
+      x.mem({0x0F, 0xB6}, X86Emitter::AL, offsetInCpu(&A));
+      x.emit({0x84, 0xC0}); // test al, al
+      skipBranch = opcode == 0x60 ? 0x85 : 0x84;
+      return true;
+    case 0xD5: // DJNZ direct, rel
+      if (!lowDirect) {
+        return false;
+      }
+      x.mem({0x80}, 5, data + insn.operand1); // sub byte [direct], 1
+      x.imm8(1);
+      skipBranch = 0x84;
+      return true;
+    case 0xB4: // CJNE A, #imm, rel
+      x.mem({0x0F, 0xB6}, X86Emitter::AL, offsetInCpu(&A));
+      emitCompareJump(x, insn.operand1);
+      skipBranch = 0x84;
+      return true;
     }
 
-    case 0x88:
-    case 0x89:
-    case 0x8A:
-    case 0x8B:
-    case 0x8C:
-    case 0x8D:
-    case 0x8E:
-    case 0x8F: // MOV direct, Rn
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(addr, readRegister(opcode & 0x07));
-      cycleCount += 2;
-      break;
+    switch (opcode & 0xF8) {
+    case 0x08: // INC Rn
+    case 0x18: // DEC Rn
+    case 0xD8: // DJNZ Rn, rel
+      emitLoadBank(x);
+      x.bankMem({0x80}, (opcode & 0xF8) == 0x08 ? 0 : 5, data + reg);
+      x.imm8(1);
+      skipBranch = (opcode & 0xF8) == 0xD8 ? 0x84 : 0;
+      return true;
+    case 0x78: // MOV Rn, #imm
+      emitLoadBank(x);
+      x.bankMem({0xC6}, 0, data + reg);
+      x.imm8(insn.operand1);
+      return true;
+    case 0xE8: // MOV A, Rn
+      emitLoadBank(x);
+      x.bankMem({0x0F, 0xB6}, X86Emitter::AL, data + reg);
+      emitStoreA(x);
+      return true;
+    case 0xF8: // MOV Rn, A
+      emitLoadBank(x);
+      x.mem({0x0F, 0xB6}, X86Emitter::CL, offsetInCpu(&A));
+      x.bankMem({0x88}, X86Emitter::CL, data + reg);
+      return true;
+    case 0xB8: // CJNE Rn, #imm, rel
+      emitLoadBank(x);
+      x.bankMem({0x0F, 0xB6}, X86Emitter::AL, data + reg);
+      emitCompareJump(x, insn.operand1);
+      skipBranch = 0x84;
+      return true;
     }
+    return false;
+  }
 
-    // 0x9X - MOV DPTR, MOVC, SUBB variants
-    case 0x90: // MOV DPTR, #data16
-    {
-      uint8_t high = fetch();
-      uint8_t low = fetch();
-      DPTR = (high << 8) | low;
-      // Sync DPTR to SFRs
-      dataMemory[0x82] = DPTR & 0xFF; // DPL
-      dataMemory[0x83] = DPTR >> 8;   // DPH
-      cycleCount += 2;
-      break;
+  // Translates a block into a function that charges its cycles, runs it and
+  // leaves PC at the successor. A block that branches back to its own start
+  // keeps looping in native code while the whole block still fits before
+  // endCycle, which is exactly when runBlocks() would run it again. endCycle
+  // is read on every pass, since the block's own stores may move it.
+  JitFunction compileBlock(BasicBlock &block) {
+    X86Emitter x;
+    const int32_t cycles = offsetInCpu(&cycleCount);
+    std::vector<size_t> exits;
+
+    x.emit({0x53});                 // push rbx, also aligns the stack
+    x.emit({0x48, 0x89, 0xFB});     // mov rbx, rdi
+    x.mem({0x48, 0x81}, 0, cycles); // add qword [cycleCount], imm32
+    x.imm32(block.cycles);
+    size_t body = x.position();
+
+    uint16_t next = block.start;
+    uint32_t later = block.cycles;
+    for (uint32_t i = 0; i < block.count; ++i) {
+      const DecodedInstruction &insn = blockCode[block.first + i];
+      next += insn.length;
+      later -= insn.cycles;
+      uint8_t skipBranch;
+      if (!emitNative(x, insn, skipBranch)) {
+        block.sideEffects |= hasSideEffects(insn);
+        emitSetPC(x, next);
+        x.emit({0x48, 0x89, 0xDF}); // mov rdi, rbx
+        x.emit({0x48, 0xBE});       // mov rsi, imm64
+        x.imm64(packInstruction(insn, later));
+        x.emit({0x48, 0xB8}); // mov rax, imm64
+        x.imm64(reinterpret_cast<uint64_t>(&Intel8051::jitInterpret));
+        x.emit({0xFF, 0xD0}); // call rax
+        if (i + 1 == block.count) {
+          exits.push_back(x.jump({0xE9})); // The handler has set PC
+        } else {
+          x.emit({0x84, 0xC0}); // test al, al
+          exits.push_back(x.jump({0x0F, 0x85}));
+        }
+        continue;
+      }
+      if (skipBranch == 0) {
+        continue;
+      }
+
+      size_t notTaken = 0;
+      if (skipBranch != 0xFF) {
+        notTaken = x.jump({0x0F, skipBranch});
+      }
+      if (insn.target == block.start) {
+        // mov rax, [cycleCount]; add rax, imm32; cmp rax, [endCycle];
+        // ja budget
+        x.mem({0x48, 0x8B}, X86Emitter::AL, cycles);
+        x.emit({0x48, 0x05});
+        x.imm32(block.cycles);
+        x.mem({0x48, 0x3B}, X86Emitter::AL, offsetInCpu(&endCycle));
+        block.loops = true;
+        size_t budget = x.jump({0x0F, 0x87});
+        x.mem({0x48, 0x89}, X86Emitter::AL, cycles); // mov [cycleCount], rax
+        x.bind(x.jump({0xE9}), body);
+        x.bind(budget, x.position());
+      }
+      emitSetPC(x, insn.target);
+      exits.push_back(x.jump({0xE9}));
+      if (skipBranch != 0xFF) {
+        x.bind(notTaken, x.position());
+      }
     }
 
-    case 0x92: // MOV bit, C
-    {
-      uint8_t bitAddr = fetch();
-      writeBit(bitAddr, getCarryFlag());
-      cycleCount += 2;
-      break;
+    emitSetPC(x, block.fallThrough);
+    for (size_t exit : exits) {
+      x.bind(exit, x.position());
     }
+    x.emit({0x5B, 0xC3}); // pop rbx; ret
 
-    case 0x93: // MOVC A, @A+DPTR
-      A = programMemory[(A + DPTR) & 0xFFFF];
-      updateParity();
-      cycleCount += 2;
-      break;
+    return reinterpret_cast<JitFunction>(jitCode.append(x.code));
+  }
+#elif INTEL8051_JIT_WASM
+  // Pushes cpu + registerBankBase, the base address for Rn
+  void wasmBankAddress(WasmEmitter &w) {
+    w.localGet(WasmEmitter::Cpu);
+    w.localGet(WasmEmitter::Cpu);
+    w.load8(offsetInCpu(&registerBankBase));
+    w.op(0x6A); // i32.add
+  }
 
-    case 0x94: // SUBB A, #data
-    {
-      uint8_t data = fetch();
-      int carry = getCarryFlag() ? 1 : 0;
-      int result = A - data - carry;
-      setCarryFlag(result < 0);
-      setAuxCarryFlag((int)(A & 0x0F) - (int)(data & 0x0F) - carry < 0);
-      setOverflowFlag(((A ^ data) & (A ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
-    }
+  // A = value on the stack, with P evaluated right away (see updateParity())
+  void wasmStoreA(WasmEmitter &w) {
+    w.i32Const(0xFF);
+    w.op(0x71); // i32.and
+    w.localSet(WasmEmitter::T);
+    w.localGet(WasmEmitter::Cpu);
+    w.localGet(WasmEmitter::T);
+    w.store8(offsetInCpu(&A));
+    w.localGet(WasmEmitter::Cpu);
+    w.localGet(WasmEmitter::Cpu);
+    w.load8(offsetInCpu(&PSW));
+    w.i32Const(0xFE);
+    w.op(0x71); // i32.and
+    w.localGet(WasmEmitter::T);
+    w.op(0x69); // i32.popcnt
+    w.i32Const(1);
+    w.op(0x71); // i32.and
+    w.op(0x72); // i32.or
+    w.store8(offsetInCpu(&PSW));
+  }
 
-    case 0x95: // SUBB A, direct
-    {
-      uint8_t data = readDataMemory(fetch());
-      int carry = getCarryFlag() ? 1 : 0;
-      int result = A - data - carry;
-      setCarryFlag(result < 0);
-      setAuxCarryFlag((int)(A & 0x0F) - (int)(data & 0x0F) - carry < 0);
-      setOverflowFlag(((A ^ data) & (A ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
-    }
+  // Carry flag = value on the stack (0 or 1), as setCarryFlag() does
+  void wasmStoreCarry(WasmEmitter &w) {
+    w.i32Const(7);
+    w.op(0x74); // i32.shl
+    w.localSet(WasmEmitter::U);
+    w.localGet(WasmEmitter::Cpu);
+    w.localGet(WasmEmitter::Cpu);
+    w.load8(offsetInCpu(&PSW));
+    w.i32Const(0x7F);
+    w.op(0x71); // i32.and
+    w.localGet(WasmEmitter::U);
+    w.op(0x72); // i32.or
+    w.store8(offsetInCpu(&PSW));
+  }
 
-    case 0x96: // SUBB A, @R0
-    {
-      uint8_t data = readDataMemory(readRegister(0));
-      int carry = getCarryFlag() ? 1 : 0;
-      int result = A - data - carry;
-      setCarryFlag(result < 0);
-      setAuxCarryFlag((int)(A & 0x0F) - (int)(data & 0x0F) - carry < 0);
-      setOverflowFlag(((A ^ data) & (A ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
+  // CJNE on the value on the stack: sets carry, pushes "not equal"
+  void wasmCompareJump(WasmEmitter &w, uint8_t data) {
+    w.localSet(WasmEmitter::T);
+    w.localGet(WasmEmitter::T);
+    w.i32Const(data);
+    w.op(0x49); // i32.lt_u
+    wasmStoreCarry(w);
+    w.localGet(WasmEmitter::T);
+    w.i32Const(data);
+    w.op(0x47); // i32.ne
+  }
+
+  // Decrements the byte at the address on the stack plus offset and pushes
+  // the new value, for DJNZ
+  void wasmDecrement(WasmEmitter &w, uint32_t offset) {
+    w.localTee(WasmEmitter::P);
+    w.localGet(WasmEmitter::P);
+    w.load8(offset);
+    w.i32Const(1);
+    w.op(0x6B); // i32.sub
+    w.i32Const(0xFF);
+    w.op(0x71); // i32.and
+    w.localTee(WasmEmitter::T);
+    w.store8(offset);
+    w.localGet(WasmEmitter::T);
+  }
+
+  void wasmSetPC(WasmEmitter &w, uint16_t value) {
+    w.localGet(WasmEmitter::Cpu);
+    w.i32Const(value);
+    w.store16(offsetInCpu(&PC));
+  }
+
+  enum class WasmBranch { None, Conditional, Always };
+
+  // The WebAssembly counterpart of the x86 emitNative(): the same
+  // instructions are translated, conditional branches leave their condition
+  // on the stack.
+  bool emitWasmNative(WasmEmitter &w, const DecodedInstruction &insn,
+                      WasmBranch &branch) {
+    const uint32_t data = offsetInCpu(dataMemory);
+    const uint8_t opcode = insn.opcode;
+    const uint8_t reg = opcode & 0x07;
+    const bool lowDirect = insn.operand1 < 0x80;
+    branch = WasmBranch::None;
+
+    if (opcode == 0x00) { // NOP
+      return true;
+    }
+    if (opcode == 0x02 || opcode == 0x80 || (opcode & 0x1F) == 0x01) {
+      branch = WasmBranch::Always; // LJMP, SJMP, AJMP
+      return true;
+    }
+    switch (opcode) {
+    case 0x04: // INC A
+    case 0x14: // DEC A
+      w.localGet(WasmEmitter::Cpu);
+      w.load8(offsetInCpu(&A));
+      w.i32Const(1);
+      w.op(opcode == 0x04 ? 0x6A : 0x6B); // i32.add / i32.sub
+      wasmStoreA(w);
+      return true;
+    case 0x74: // MOV A, #imm
+    case 0xE4: // CLR A
+      w.i32Const(opcode == 0xE4 ? 0 : insn.operand1);
+      wasmStoreA(w);
+      return true;
+    case 0xE5: // MOV A, direct
+      if (!lowDirect) {
+        return false;
+      }
+      w.localGet(WasmEmitter::Cpu);
+      w.load8(data + insn.operand1);
+      wasmStoreA(w);
+      return true;
+    case 0x75: // MOV direct, #imm
+      if (!lowDirect) {
+        return false;
+      }
+      w.localGet(WasmEmitter::Cpu);
+      w.i32Const(insn.operand2);
+      w.store8(data + insn.operand1);
+      return true;
+    case 0xF5: // MOV direct, A
+      if (!lowDirect) {
+        return false;
+      }
+      w.localGet(WasmEmitter::Cpu);
+      w.localGet(WasmEmitter::Cpu);
+      w.load8(offsetInCpu(&A));
+      w.store8(data + insn.operand1);
+      return true;
+    case 0xC3: // CLR C
+    case 0xD3: // SETB C
+      w.i32Const(opcode == 0xD3);
+      wasmStoreCarry(w);
+      return true;
+    case 0x40: // JC
+    case 0x50: // JNC
+      w.localGet(WasmEmitter::Cpu);
+      w.load8(offsetInCpu(&PSW));
+      w.i32Const(0x80);
+      w.op(0x71); // i32.and
+      if (opcode == 0x50) {
+        w.op(0x45); // i32.eqz
+      }
+      branch = WasmBranch::Conditional;
+      return true;
+    case 0x60: // JZ
+    case 0x70: // JNZ
+      w.localGet(WasmEmitter::Cpu);
+      w.load8(offsetInCpu(&A));
+      if (opcode == 0x60) {
+        w.op(0x45); // i32.eqz
+      }
+      branch = WasmBranch::Conditional;
+      return true;
+    case 0xD5: // DJNZ direct, rel
+      if (!lowDirect) {
+        return false;
+      }
+      w.localGet(WasmEmitter::Cpu);
+      wasmDecrement(w, data + insn.operand1);
+      branch = WasmBranch::Conditional;
+      return true;
+    case 0xB4: // CJNE A, #imm, rel
+      w.localGet(WasmEmitter::Cpu);
+      w.load8(offsetInCpu(&A));
+      wasmCompareJump(w, insn.operand1);
+      branch = WasmBranch::Conditional;
+      return true;
     }
 
-    case 0x97: // SUBB A, @R1
-    {
-      uint8_t data = readDataMemory(readRegister(1));
-      int carry = getCarryFlag() ? 1 : 0;
-      int result = A - data - carry;
-      setCarryFlag(result < 0);
-      setAuxCarryFlag((int)(A & 0x0F) - (int)(data & 0x0F) - carry < 0);
-      setOverflowFlag(((A ^ data) & (A ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
+    switch (opcode & 0xF8) {
+    case 0x08: // INC Rn
+    case 0x18: // DEC Rn
+      wasmBankAddress(w);
+      w.localTee(WasmEmitter::P);
+      w.localGet(WasmEmitter::P);
+      w.load8(data + reg);
+      w.i32Const(1);
+      w.op((opcode & 0xF8) == 0x08 ? 0x6A : 0x6B); // i32.add / i32.sub
+      w.store8(data + reg);
+      return true;
+    case 0xD8: // DJNZ Rn, rel
+      wasmBankAddress(w);
+      wasmDecrement(w, data + reg);
+      branch = WasmBranch::Conditional;
+      return true;
+    case 0x78: // MOV Rn, #imm
+      wasmBankAddress(w);
+      w.i32Const(insn.operand1);
+      w.store8(data + reg);
+      return true;
+    case 0xE8: // MOV A, Rn
+      wasmBankAddress(w);
+      w.load8(data + reg);
+      wasmStoreA(w);
+      return true;
+    case 0xF8: // MOV Rn, A
+      wasmBankAddress(w);
+      w.localGet(WasmEmitter::Cpu);
+      w.load8(offsetInCpu(&A));
+      w.store8(data + reg);
+      return true;
+    case 0xB8: // CJNE Rn, #imm, rel
+      wasmBankAddress(w);
+      w.load8(data + reg);
+      wasmCompareJump(w, insn.operand1);
+      branch = WasmBranch::Conditional;
+      return true;
     }
+    return false;
+  }
 
-    case 0x98:
-    case 0x99:
-    case 0x9A:
-    case 0x9B:
-    case 0x9C:
-    case 0x9D:
-    case 0x9E:
-    case 0x9F: // SUBB A, Rn
-    {
-      uint8_t data = readRegister(opcode & 0x07);
-      int carry = getCarryFlag() ? 1 : 0;
-      int result = A - data - carry;
-      setCarryFlag(result < 0);
-      setAuxCarryFlag((int)(A & 0x0F) - (int)(data & 0x0F) - carry < 0);
-      setOverflowFlag(((A ^ data) & (A ^ result) & 0x80) != 0);
-      A = result & 0xFF;
-      updateParity();
-      cycleCount += 1;
-      break;
+  // Same contract as the x86 compileBlock(): charges the block's cycles,
+  // runs it, leaves PC at the successor and loops on itself while the whole
+  // block still fits before the current endCycle.
+  JitFunction compileBlock(BasicBlock &block) {
+    WasmEmitter w;
+    const uint32_t cycles = offsetInCpu(&cycleCount);
+
+    w.localGet(WasmEmitter::Cpu);
+    w.localGet(WasmEmitter::Cpu);
+    w.load64(cycles);
+    w.i64Const(block.cycles);
+    w.op(0x7C); // i64.add
+    w.store64(cycles);
+    w.op(0x03); // loop
+    w.op(0x40);
+
+    uint16_t next = block.start;
+    uint32_t later = block.cycles;
+    for (uint32_t i = 0; i < block.count; ++i) {
+      const DecodedInstruction &insn = blockCode[block.first + i];
+      next += insn.length;
+      later -= insn.cycles;
+      WasmBranch branch;
+      if (!emitWasmNative(w, insn, branch)) {
+        block.sideEffects |= hasSideEffects(insn);
+        wasmSetPC(w, next);
+        w.localGet(WasmEmitter::Cpu);
+        w.i64Const(packInstruction(insn, later));
+        w.op(0x10); // call e.i
+        w.u32(0);
+        if (i + 1 == block.count) {
+          w.op(0x0F); // return, the handler has set PC
+        } else {
+          w.op(0x04); // if the block ends here
+          w.op(0x40);
+          w.op(0x0F); // return
+          w.op(0x0B); // end
+        }
+        continue;
+      }
+      if (branch == WasmBranch::None) {
+        continue;
+      }
+
+      if (branch == WasmBranch::Conditional) {
+        w.op(0x04); // if
+        w.op(0x40);
+      }
+      if (insn.target == block.start) {
+        block.loops = true;
+        w.localGet(WasmEmitter::Cpu);
+        w.load64(cycles);
+        w.i64Const(block.cycles);
+        w.op(0x7C); // i64.add
+        w.localTee(WasmEmitter::C);
+        w.localGet(WasmEmitter::Cpu);
+        w.load64(offsetInCpu(&endCycle));
+        w.op(0x58); // i64.le_u
+        w.op(0x04); // if
+        w.op(0x40);
+        w.localGet(WasmEmitter::Cpu);
+        w.localGet(WasmEmitter::C);
+        w.store64(cycles);
+        w.op(0x0C); // br to the loop
+        w.u32(branch == WasmBranch::Conditional ? 2 : 1);
+        w.op(0x0B); // end
+      }
+      wasmSetPC(w, insn.target);
+      w.op(0x0F); // return
+      if (branch == WasmBranch::Conditional) {
+        w.op(0x0B); // end
+      }
     }
 
-    // 0xAX - ORL C, MOV variants, INC DPTR, MUL
-    case 0xA0: // ORL C, /bit
-      setCarryFlag(getCarryFlag() | !readBit(fetch()));
-      cycleCount += 2;
-      break;
+    w.op(0x0B); // end loop
+    wasmSetPC(w, block.fallThrough);
 
-    case 0xA2: // MOV C, bit
-      setCarryFlag(readBit(fetch()));
-      cycleCount += 1;
-      break;
+    std::vector<uint8_t> module = w.module();
+    uintptr_t interpret = reinterpret_cast<uintptr_t>(&Intel8051::jitInterpret);
+    int index = jitInstantiateWasm(this, module.data(), module.size(),
+                                   static_cast<int>(interpret));
+    return reinterpret_cast<JitFunction>(static_cast<uintptr_t>(index));
+  }
+#endif
+
+  struct JitSnapshot {
+    uint64_t cycles;
+    uint16_t pc;
+    uint16_t dptr;
+    uint8_t a;
+    uint8_t b;
+    uint8_t sp;
+    uint8_t psw;
+    uint8_t data[256];
+    uint64_t timerBase;
+    uint64_t timerOverflow[timerCounterCount];
+    uint64_t eventCycle[eventSourceCount];
+    uint64_t nextEvent;
+    uint64_t interruptHoldoff;
+    uint8_t interruptsActive;
+    int32_t callDepth;
+    uint32_t serialTxLeft;
+    uint32_t serialRxLeft;
+    uint8_t serialRxByte;
+  };
 
-    case 0xA3: // INC DPTR
-      DPTR++;
-      // Sync DPTR to SFRs
-      dataMemory[0x82] = DPTR & 0xFF; // DPL
-      dataMemory[0x83] = DPTR >> 8;   // DPH
-      cycleCount += 2;
-      break;
+  void saveSnapshot(JitSnapshot &snapshot) const {
+    snapshot.cycles = cycleCount;
+    snapshot.pc = PC;
+    snapshot.dptr = DPTR;
+    snapshot.a = A;
+    snapshot.b = B;
+    snapshot.sp = SP;
+    snapshot.psw = PSW;
+    memcpy(snapshot.data, dataMemory, sizeof(dataMemory));
+    snapshot.timerBase = timerBase;
+    memcpy(snapshot.timerOverflow, timerOverflow, sizeof(timerOverflow));
+    memcpy(snapshot.eventCycle, eventCycle, sizeof(eventCycle));
+    snapshot.nextEvent = nextEvent;
+    snapshot.interruptHoldoff = interruptHoldoff;
+    snapshot.interruptsActive = interruptsActive;
+    snapshot.callDepth = callDepth;
+    snapshot.serialTxLeft = serialTxLeft;
+    snapshot.serialRxLeft = serialRxLeft;
+    snapshot.serialRxByte = serialRxByte;
+  }
 
-    case 0xA4: // MUL AB
-    {
-      uint16_t result = (uint16_t)A * (uint16_t)B;
-      A = result & 0xFF;
-      B = (result >> 8) & 0xFF;
-      // Sync back to memory
-      dataMemory[0xE0] = A;
-      dataMemory[0xF0] = B;
-      setCarryFlag(false);
-      setOverflowFlag(B != 0);
-      updateParity();
-      cycleCount += 4;
-      break;
-    }
+  void restoreSnapshot(const JitSnapshot &snapshot) {
+    cycleCount = snapshot.cycles;
+    PC = snapshot.pc;
+    DPTR = snapshot.dptr;
+    A = snapshot.a;
+    B = snapshot.b;
+    SP = snapshot.sp;
+    PSW = snapshot.psw;
+    registerBankBase = PSW & 0x18;
+    memcpy(dataMemory, snapshot.data, sizeof(dataMemory));
+    timerBase = snapshot.timerBase;
+    memcpy(timerOverflow, snapshot.timerOverflow, sizeof(timerOverflow));
+    memcpy(eventCycle, snapshot.eventCycle, sizeof(eventCycle));
+    nextEvent = snapshot.nextEvent;
+    interruptHoldoff = snapshot.interruptHoldoff;
+    interruptsActive = snapshot.interruptsActive;
+    callDepth = snapshot.callDepth;
+    serialTxLeft = snapshot.serialTxLeft;
+    serialRxLeft = snapshot.serialRxLeft;
+    serialRxByte = snapshot.serialRxByte;
+  }
 
-    case 0xA5: // Undefined (reserved)
-      std::cerr << "Warning: Undefined opcode 0xA5 at PC=0x" << std::hex
-                << std::setw(4) << std::setfill('0') << (PC - 1) << std::dec
-                << std::endl;
-      cycleCount += 1;
-      break;
+  static bool sameSnapshot(const JitSnapshot &a, const JitSnapshot &b) {
+    return a.cycles == b.cycles && a.pc == b.pc && a.dptr == b.dptr &&
+           a.a == b.a && a.b == b.b && a.sp == b.sp && a.psw == b.psw &&
+           a.timerBase == b.timerBase && a.nextEvent == b.nextEvent &&
+           a.interruptsActive == b.interruptsActive &&
+           a.callDepth == b.callDepth && a.serialTxLeft == b.serialTxLeft &&
+           a.serialRxLeft == b.serialRxLeft &&
+           memcmp(a.data, b.data, sizeof(a.data)) == 0;
+  }
 
-    case 0xA6: // MOV @R0, direct
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(readRegister(0), readDataMemory(addr));
-      cycleCount += 2;
-      break;
+  // Runs the native block, then the interpreter from the same starting
+  // state, and keeps the interpreter's result. A block that loops on itself
+  // makes as many passes on the interpreter as runBlocks() would, so the
+  // native loop is checked against endCycle moving under it too. A block
+  // that disagrees is reported and never run natively again.
+  void verifyJitBlock(BasicBlock &block) {
+    JitSnapshot before, native, interpreted;
+    saveSnapshot(before);
+    uint64_t end = endCycle;
+    block.jit(this);
+    saveSnapshot(native);
+    restoreSnapshot(before);
+    endCycle = end;
+    do {
+      executeBlock(block);
+    } while (block.loops && PC == block.start &&
+             cycleCount + block.cycles <= endCycle);
+    syncFlags();
+    saveSnapshot(interpreted);
+
+    if (!sameSnapshot(native, interpreted)) {
+      jitMismatches++;
+      block.jit = nullptr;
+      std::cerr << "JIT mismatch in block at 0x" << std::hex << std::setw(4)
+                << std::setfill('0') << block.start << ": PC " << std::setw(4)
+                << native.pc << " vs " << std::setw(4) << interpreted.pc
+                << ", A " << std::setw(2) << static_cast<int>(native.a)
+                << " vs " << std::setw(2) << static_cast<int>(interpreted.a)
+                << ", PSW " << std::setw(2) << static_cast<int>(native.psw)
+                << " vs " << std::setw(2) << static_cast<int>(interpreted.psw)
+                << std::dec << ", cycles " << native.cycles << " vs "
+                << interpreted.cycles << std::endl;
     }
+  }
 
-    case 0xA7: // MOV @R1, direct
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(readRegister(1), readDataMemory(addr));
-      cycleCount += 2;
-      break;
+  void runJitBlock(int32_t index) {
+    BasicBlock &block = blocks[index];
+    if (block.jit == nullptr) {
+      if (++block.executions == jitThreshold && !endsInSelfLoop(block)) {
+        block.jit = compileBlock(block);
+      }
+      if (block.jit == nullptr) {
+        executeBlock(block);
+        return;
+      }
     }
 
-    case 0xA8:
-    case 0xA9:
-    case 0xAA:
-    case 0xAB:
-    case 0xAC:
-    case 0xAD:
-    case 0xAE:
-    case 0xAF: // MOV Rn, direct
-    {
-      uint8_t addr = fetch();
-      writeRegister(opcode & 0x07, readDataMemory(addr));
-      cycleCount += 2;
-      break;
+    syncFlags(); // Translated code expects evaluated flags in PSW
+    if (jitMode == JitMode::Lockstep) {
+      if (block.sideEffects) {
+        executeBlock(block);
+      } else {
+        verifyJitBlock(block);
+      }
+    } else {
+      block.jit(this);
     }
+  }
+#endif
 
-    // 0xBX - ANL C, CPL variants, CJNE variants
-    case 0xB0: // ANL C, /bit
-      setCarryFlag(getCarryFlag() & !readBit(fetch()));
-      cycleCount += 2;
-      break;
-
-    case 0xB2: // CPL bit
-    {
-      uint8_t bitAddr = fetch();
-      writeBit(bitAddr, !readBit(bitAddr));
-      cycleCount += 1;
-      break;
+  void runBlocks(uint64_t maxCycles) {
+    if (blockAt.empty()) {
+      blockAt.assign(sizeof(programMemory), -1);
     }
 
-    case 0xB3: // CPL C
-      setCarryFlag(!getCarryFlag());
-      cycleCount += 1;
-      break;
+    beginRun(maxCycles);
+    int32_t index = lookupBlock(PC);
 
-    case 0xB4: // CJNE A, #data, rel
-    {
-      uint8_t data = fetch();
-      int8_t offset = fetch();
-      setCarryFlag(A < data);
-      if (A != data) {
-        PC += offset;
+    while (running) {
+      const BasicBlock &block = blocks[index];
+      if (endCycle - cycleCount < block.cycles) {
+        // The budget or the next event comes up inside this block:
+        // finish one instruction at a time so the run stops exactly where
+        // the other engines stop.
+        while (running) {
+          executeSwitch();
+          if (cycleCount >= endCycle) {
+            break;
+          }
+        }
+        if (!continueRun()) {
+          return;
+        }
+        index = lookupBlock(PC);
+        continue;
       }
-      cycleCount += 2;
-      break;
-    }
 
-    case 0xB5: // CJNE A, direct, rel
-    {
-      uint8_t data = readDataMemory(fetch());
-      int8_t offset = fetch();
-      setCarryFlag(A < data);
-      if (A != data) {
-        PC += offset;
+#if INTEL8051_HAS_JIT
+      if (jitMode != JitMode::Off) {
+        runJitBlock(index);
+      } else {
+        executeBlock(block);
       }
-      cycleCount += 2;
-      break;
-    }
-
-    case 0xB6: // CJNE @R0, #data, rel
-    {
-      uint8_t val = readDataMemory(readRegister(0));
-      uint8_t data = fetch();
-      int8_t offset = fetch();
-      setCarryFlag(val < data);
-      if (val != data) {
-        PC += offset;
+#else
+      executeBlock(block);
+#endif
+      if (cycleCount >= endCycle && !continueRun()) {
+        break;
       }
-      cycleCount += 2;
-      break;
+      index = nextBlock(index);
     }
+  }
 
-    case 0xB7: // CJNE @R1, #data, rel
-    {
-      uint8_t val = readDataMemory(readRegister(1));
-      uint8_t data = fetch();
-      int8_t offset = fetch();
-      setCarryFlag(val < data);
-      if (val != data) {
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
+  bool isBreakpoint(uint16_t addr) const {
+    return breakpoints[addr >> 6] >> (addr & 63) & 1;
+  }
+
+  void watchData(uint8_t addr, uint8_t access) {
+    if ((dataWatch[addr] & access) && !watchHit) {
+      watchHit = true;
+      watchHitExternal = false;
+      watchHitAccess = dataWatch[addr] & access;
+      watchHitAddress = addr;
     }
+  }
 
-    case 0xB8:
-    case 0xB9:
-    case 0xBA:
-    case 0xBB:
-    case 0xBC:
-    case 0xBD:
-    case 0xBE:
-    case 0xBF: // CJNE Rn, #data, rel
-    {
-      uint8_t val = readRegister(opcode & 0x07);
-      uint8_t data = fetch();
-      int8_t offset = fetch();
-      setCarryFlag(val < data);
-      if (val != data) {
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
+  void watchExternal(uint16_t addr, uint8_t access) {
+    if (!externalWatch.empty() && (externalWatch[addr] & access) &&
+        !watchHit) {
+      watchHit = true;
+      watchHitExternal = true;
+      watchHitAccess = externalWatch[addr] & access;
+      watchHitAddress = addr;
     }
+  }
 
-    // 0xCX - PUSH, CLR, SWAP, XCH variants
-    case 0xC0: // PUSH direct
-    {
-      uint8_t addr = fetch();
-      push(readDataMemory(addr));
-      cycleCount += 2;
-      break;
+  // Byte holding a bit address
+  static uint8_t bitByte(uint8_t bitAddr) {
+    return bitAddr < 0x80 ? 0x20 + (bitAddr >> 3) : bitAddr & 0xF8;
+  }
+
+  // Reports the memory the instruction at PC is about to access to
+  // watchData() and watchExternal(). Only addressed operands count: direct,
+  // indirect, register, bit and stack accesses and MOVX, not the implicit
+  // use of A, B, PSW, SP or DPTR, and not what system calls touch.
+  void watchAccesses(const DecodedInstruction &insn) {
+    uint8_t opcode = insn.opcode;
+    uint8_t row = opcode >> 4;
+    uint8_t column = opcode & 0x0F;
+    uint8_t bank = registerBankBase;
+
+    if (column >= 5) {
+      // Operand X of the regular rows: direct, @Ri or Rn
+      uint8_t x;
+      if (column == 5) {
+        x = insn.operand1;
+      } else if (column < 8) {
+        watchData(bank + (column & 1), WatchRead);
+        x = dataMemory[bank + (column & 1)];
+      } else {
+        x = bank + (column & 7);
+      }
+      switch (row) {
+      case 0x7: // MOV X, #imm
+      case 0xF: // MOV X, A
+        watchData(x, WatchWrite);
+        break;
+      case 0x8: // MOV direct, X
+        if (column == 5) {
+          watchData(insn.operand1, WatchRead);
+          watchData(insn.operand2, WatchWrite);
+        } else {
+          watchData(x, WatchRead);
+          watchData(insn.operand1, WatchWrite);
+        }
+        break;
+      case 0xA: // MOV X, direct
+        if (column != 5) {
+          watchData(insn.operand1, WatchRead);
+          watchData(x, WatchWrite);
+        }
+        break;
+      case 0x0: // INC
+      case 0x1: // DEC
+      case 0xC: // XCH
+      case 0xD: // DJNZ, XCHD
+        watchData(x, WatchRead | WatchWrite);
+        break;
+      default: // ADD, ADDC, ORL, ANL, XRL, SUBB, CJNE, MOV A, X
+        watchData(x, WatchRead);
+        break;
+      }
+      return;
     }
 
+    switch (opcode) {
+    case 0x10: // JBC clears the bit if it was set
+      watchData(bitByte(insn.operand1),
+                readBit(insn.operand1) ? WatchRead | WatchWrite : WatchRead);
+      break;
+    case 0x20: // JB
+    case 0x30: // JNB
+    case 0x72: // ORL C, bit
+    case 0x82: // ANL C, bit
+    case 0xA0: // ORL C, /bit
+    case 0xA2: // MOV C, bit
+    case 0xB0: // ANL C, /bit
+      watchData(bitByte(insn.operand1), WatchRead);
+      break;
+    case 0x92: // MOV bit, C
+    case 0xB2: // CPL bit
     case 0xC2: // CLR bit
-    {
-      uint8_t bitAddr = fetch();
-      writeBit(bitAddr, false);
-      cycleCount += 1;
+    case 0xD2: // SETB bit
+      watchData(bitByte(insn.operand1), WatchWrite);
       break;
-    }
-
-    case 0xC3: // CLR C (Clear Carry)
-      setCarryFlag(false);
-      cycleCount += 1;
+    case 0x42: // ORL direct, A
+    case 0x43: // ORL direct, #imm
+    case 0x52: // ANL
+    case 0x53:
+    case 0x62: // XRL
+    case 0x63:
+      watchData(insn.operand1, WatchRead | WatchWrite);
       break;
-
-    case 0xC4: // SWAP A
-      A = ((A & 0x0F) << 4) | ((A & 0xF0) >> 4);
-      updateParity();
-      cycleCount += 1;
+    case 0xC0: // PUSH
+      watchData(insn.operand1, WatchRead);
+      watchData(SP + 1, WatchWrite);
       break;
-
-    case 0xC5: // XCH A, direct
-    {
-      uint8_t addr = fetch();
-      uint8_t temp = A;
-      A = readDataMemory(addr);
-      writeDataMemory(addr, temp);
-      updateParity();
-      cycleCount += 1;
+    case 0xD0: // POP
+      watchData(SP, WatchRead);
+      watchData(insn.operand1, WatchWrite);
       break;
-    }
-
-    case 0xC6: // XCH A, @R0
-    {
-      uint8_t temp = A;
-      A = readDataMemory(readRegister(0));
-      writeDataMemory(readRegister(0), temp);
-      updateParity();
-      cycleCount += 1;
+    case 0x22: // RET
+    case 0x32: // RETI
+      watchData(SP, WatchRead);
+      watchData(SP - 1, WatchRead);
       break;
-    }
-
-    case 0xC7: // XCH A, @R1
-    {
-      uint8_t temp = A;
-      A = readDataMemory(readRegister(1));
-      writeDataMemory(readRegister(1), temp);
-      updateParity();
-      cycleCount += 1;
+    case 0xE0: // MOVX A, @DPTR
+      watchExternal(DPTR, WatchRead);
       break;
-    }
-
-    case 0xC8:
-    case 0xC9:
-    case 0xCA:
-    case 0xCB:
-    case 0xCC:
-    case 0xCD:
-    case 0xCE:
-    case 0xCF: // XCH A, Rn
-    {
-      uint8_t reg = opcode & 0x07;
-      uint8_t temp = A;
-      A = readRegister(reg);
-      writeRegister(reg, temp);
-      updateParity();
-      cycleCount += 1;
+    case 0xF0: // MOVX @DPTR, A
+      watchExternal(DPTR, WatchWrite);
       break;
-    }
-
-    case 0xD0: // POP direct
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(addr, pop());
-      cycleCount += 2;
+    case 0xE2: // MOVX A, @Ri
+    case 0xE3:
+    case 0xF2: // MOVX @Ri, A
+    case 0xF3:
+      watchData(bank + (opcode & 1), WatchRead);
+      watchExternal(dataMemory[bank + (opcode & 1)],
+                    opcode < 0xF0 ? WatchRead : WatchWrite);
       break;
-    }
-
-    case 0xD2: // SETB bit
-    {
-      uint8_t bitAddr = fetch();
-      writeBit(bitAddr, true);
-      cycleCount += 1;
+    default:
+      // ACALL and LCALL push the return address unless a system call
+      // handles them
+      if (((opcode & 0x1F) == 0x11 || opcode == 0x12) &&
+          !isSystemCall(insn.target)) {
+        watchData(SP + 1, WatchWrite);
+        watchData(SP + 2, WatchWrite);
+      }
       break;
     }
+  }
 
-    case 0xD3: // SETB C (Set Carry)
-      setCarryFlag(true);
-      cycleCount += 1;
-      break;
-
-    case 0xD4: // DA A (Decimal Adjust Accumulator)
-    {
-      // Decimal adjust after addition for BCD arithmetic
-      uint8_t correction = 0;
+  // Run loop used while breakpoints or watchpoints are set. It goes one
+  // instruction at a time, so the dispatch engines never pay for the
+  // checks. A breakpoint at the PC a run starts from is passed over, which
+  // lets a stopped program continue; a watchpoint stops the run after the
+  // instruction that hit it.
+  void runDebug(uint64_t maxCycles) {
+    syncDecodeCache();
+    beginRun(maxCycles);
+    bool first = true;
 
-      // Check lower nibble
-      if ((A & 0x0F) > 9 || getAuxCarryFlag()) {
-        correction += 0x06;
+    while (running) {
+      if (!first && isBreakpoint(PC)) {
+        stopRun(StopReason::Breakpoint);
+        break;
       }
+      first = false;
 
-      // Check upper nibble
-      if (((A & 0xF0) >> 4) > 9 || getCarryFlag() ||
-          (((A & 0xF0) >> 4) >= 9 && (A & 0x0F) > 9)) {
-        correction += 0x60;
-        setCarryFlag(true);
+      const DecodedInstruction &insn = decodeCache[PC];
+      uint16_t at = PC;
+      watchHit = false;
+      if (watchpointCount > 0) {
+        watchAccesses(insn);
       }
+      // Busy-wait loops on a breakpoint or watched location run one
+      // iteration at a time
+      if (watchHit || isBreakpoint(insn.target)) {
+        endCycle = 0;
+      }
+      executeSwitch();
+      endCycle = std::min(runEnd, nextEvent);
 
-      // Apply correction
-      uint16_t result = A + correction;
-      A = result & 0xFF;
-
-      // Update flags
-      if (result > 0xFF) {
-        setCarryFlag(true);
+      if (watchHit) {
+        watchHitPC = at;
+        if (running) {
+          stopRun(StopReason::Watchpoint);
+        }
+        break;
+      }
+      if (cycleCount >= endCycle && !continueRun()) {
+        break;
       }
-      updateParity();
+    }
+  }
 
-      cycleCount += 1;
-      break;
+public:
+  void executeInstruction() {
+    syncDecodeCache();
+    stopReason = StopReason::CycleLimit;
+    endCycle = 0; // A single step never skips ahead
+    pollSerialInput();
+    if (cycleCount >= nextEvent) {
+      int32_t depth = callDepth;
+      dispatchEvents();
+      if (callDepth != depth) {
+        return; // The step is the call to an interrupt vector
+      }
+    }
+    if (defaultDispatchEngine == DispatchEngine::Table ||
+        defaultDispatchEngine == DispatchEngine::Threaded) {
+      executeTable();
+    } else {
+      executeSwitch();
     }
+  }
 
-    case 0xD5: // DJNZ direct, rel
-    {
-      uint8_t addr = fetch();
-      int8_t offset = fetch();
-      uint8_t value = readDataMemory(addr) - 1;
-      writeDataMemory(addr, value);
-      if (value != 0) {
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
+  // Run loop for one dispatch engine. run() uses the engine selected at build
+  // time; the benchmark instantiates all of them.
+  template <DispatchEngine engine> void runEngine(uint64_t maxCycles) {
+    syncDecodeCache();
+    if (engine == DispatchEngine::Block) {
+      runBlocks(maxCycles);
+      return;
+    }
+#if INTEL8051_HAS_THREADED_DISPATCH
+    if (engine == DispatchEngine::Threaded) {
+      runThreaded(maxCycles);
+      return;
     }
+#endif
+    beginRun(maxCycles);
 
-    case 0xD6: // XCHD A, @R0
-    {
-      uint8_t addr = readRegister(0);
-      uint8_t temp = A & 0x0F;
-      A = (A & 0xF0) | (readDataMemory(addr) & 0x0F);
-      writeDataMemory(addr, (readDataMemory(addr) & 0xF0) | temp);
-      updateParity();
-      cycleCount += 1;
-      break;
+    while (running) {
+      if (engine == DispatchEngine::Switch) {
+        executeSwitch();
+      } else {
+        executeTable();
+      }
+
+      if (cycleCount >= endCycle && !continueRun()) {
+        break;
+      }
     }
+  }
 
-    case 0xD7: // XCHD A, @R1
-    {
-      uint8_t addr = readRegister(1);
-      uint8_t temp = A & 0x0F;
-      A = (A & 0xF0) | (readDataMemory(addr) & 0x0F);
-      writeDataMemory(addr, (readDataMemory(addr) & 0xF0) | temp);
-      updateParity();
-      cycleCount += 1;
-      break;
+  void run(uint64_t maxCycles = 0) {
+    if (breakpointCount > 0 || watchpointCount > 0) {
+      runDebug(maxCycles);
+    } else {
+      runEngine<defaultDispatchEngine>(maxCycles);
     }
+  }
 
-    case 0xD8:
-    case 0xD9:
-    case 0xDA:
-    case 0xDB:
-    case 0xDC:
-    case 0xDD:
-    case 0xDE:
-    case 0xDF: // DJNZ Rn, rel
-    {
-      uint8_t reg = opcode & 0x07;
-      int8_t offset = fetch();
-      uint8_t val = readRegister(reg) - 1;
-      writeRegister(reg, val);
-      if (val != 0) {
-        PC += offset;
-      }
-      cycleCount += 2;
-      break;
+  // Breakpoints and watchpoints stay set across reset() and loading
+  void setBreakpoint(uint16_t addr, bool enabled) {
+    uint64_t bit = uint64_t(1) << (addr & 63);
+    if (isBreakpoint(addr) != enabled) {
+      breakpoints[addr >> 6] ^= bit;
+      breakpointCount += enabled ? 1 : -1;
     }
+  }
 
-    // 0xEX - MOVX, CLR A, CPL A, MOV variants
-    case 0xE0: // MOVX A, @DPTR
-      A = readExternalRAM(DPTR);
-      updateParity();
-      cycleCount += 2;
-      break;
-
-    case 0xE2: // MOVX A, @R0
-      A = readExternalRAM(readRegister(0));
-      updateParity();
-      cycleCount += 2;
-      break;
-
-    case 0xE3: // MOVX A, @R1
-      A = readExternalRAM(readRegister(1));
-      updateParity();
-      cycleCount += 2;
-      break;
-
-    case 0xE4: // CLR A
-      A = 0;
-      updateParity();
-      cycleCount += 1;
-      break;
+  void clearBreakpoints() {
+    memset(breakpoints, 0, sizeof(breakpoints));
+    breakpointCount = 0;
+  }
 
-    case 0xE5: // MOV A, direct
-    {
-      uint8_t addr = fetch();
-      A = readDataMemory(addr);
-      updateParity();
-      cycleCount += 1;
-      break;
+  // access is a WatchAccess mask, 0 removes the watchpoint
+  void setWatchpoint(bool external, uint16_t addr, uint8_t access) {
+    uint8_t *flags;
+    if (external) {
+      if (externalWatch.empty()) {
+        externalWatch.assign(sizeof(externalRAM), 0);
+      }
+      flags = &externalWatch[addr];
+    } else {
+      flags = &dataWatch[addr & 0xFF];
     }
+    access &= WatchRead | WatchWrite;
+    watchpointCount += (access != 0) - (*flags != 0);
+    *flags = access;
+  }
 
-    case 0xE6: // MOV A, @R0
-      A = readDataMemory(readRegister(0));
-      updateParity();
-      cycleCount += 1;
-      break;
-
-    case 0xE7: // MOV A, @R1
-      A = readDataMemory(readRegister(1));
-      updateParity();
-      cycleCount += 1;
-      break;
+  void clearWatchpoints() {
+    memset(dataWatch, 0, sizeof(dataWatch));
+    externalWatch.clear();
+    watchpointCount = 0;
+  }
 
-    case 0xE8:
-    case 0xE9:
-    case 0xEA:
-    case 0xEB:
-    case 0xEC:
-    case 0xED:
-    case 0xEE:
-    case 0xEF: // MOV A, Rn
-      A = readRegister(opcode & 0x07);
-      updateParity();
-      cycleCount += 1;
-      break;
+  // Where the last StopReason::Watchpoint came from
+  bool getWatchHitExternal() const { return watchHitExternal; }
+  uint8_t getWatchHitAccess() const { return watchHitAccess; }
+  uint16_t getWatchHitAddress() const { return watchHitAddress; }
+  uint16_t getWatchHitPC() const { return watchHitPC; }
 
-    // 0xFX - MOVX, CPL A, MOV variants
-    case 0xF0: // MOVX @DPTR, A
-      writeExternalRAM(DPTR, A);
-      cycleCount += 2;
-      break;
+  void step() { executeInstruction(); }
 
-    case 0xF2: // MOVX @R0, A
-      writeExternalRAM(readRegister(0), A);
-      cycleCount += 2;
-      break;
+  // Selects the JIT tier of the block engine. Has no effect in builds
+  // without JIT support, see jitAvailable().
+  void setJitMode(JitMode mode) { jitMode = mode; }
+
+  static bool jitAvailable() { return INTEL8051_HAS_JIT; }
+
+  uint64_t getJitMismatchCount() const { return jitMismatches; }
+
+  // Translates the code reachable from the reset vector into a C++ source
+  // file that runs the program without decoding or dispatching anything.
+  // Every basic block becomes a labelled run of direct handler calls, and
+  // jumps to translated blocks become gotos. Returns, JMP @A+DPTR and
+  // addresses the walk did not reach go through a switch on PC, and the
+  // interpreter runs anything that was not translated.
+  void writeStaticProgram(std::ostream &out, const std::string &sourceLabel) {
+    syncDecodeCache();
+
+    std::vector<bool> translated(sizeof(programMemory), false);
+    std::vector<uint16_t> starts;
+    std::vector<uint16_t> pending(1, 0x0000);
+    std::map<uint16_t, std::vector<uint16_t>> successors;
+    while (!pending.empty()) {
+      uint16_t start = pending.back();
+      pending.pop_back();
+      if (translated[start]) {
+        continue;
+      }
+      translated[start] = true;
+      starts.push_back(start);
+
+      uint16_t addr = start;
+      const DecodedInstruction *insn;
+      uint32_t count = 0;
+      do {
+        insn = &decodeCache[addr];
+        addr += insn->length;
+      } while (!endsBlock(*insn) && ++count < maxBlockLength);
+
+      uint8_t opcode = insn->opcode;
+      bool call = (opcode & 0x1F) == 0x11 || opcode == 0x12;
+      bool jump = opcode == 0x02 || opcode == 0x80 || (opcode & 0x1F) == 0x01;
+      bool computed = opcode == 0x22 || opcode == 0x32 || opcode == 0x73;
+      std::vector<uint16_t> &next = successors[start];
+      if (!jump && !computed) {
+        next.push_back(addr);
+      }
+      if (endsBlock(opcode) && !computed &&
+          !(call && isSystemCall(insn->target))) {
+        next.push_back(insn->target);
+      }
+      pending.insert(pending.end(), next.begin(), next.end());
+    }
+    std::sort(starts.begin(), starts.end());
+
+    out << "// Generated from " << sourceLabel
+        << " by the 8051 emulator (-c).\n"
+        << "// Build with: g++ -O2 -std=c++11 -I<emulator directory> <this "
+           "file>\n"
+        << "#define INTEL8051_STATIC_PROGRAM\n"
+        << "#include \"main.cpp\"\n\n"
+        << std::hex << std::uppercase << std::setfill('0');
+
+    // The ROM itself is still needed for MOVC, WRITE_TEXT and the
+    // interpreter fallback
+    out << "static const char programHex[] =\n";
+    for (uint32_t row = 0; row < sizeof(programMemory); row += 16) {
+      uint8_t sum = 0x10 + (row >> 8) + (row & 0xFF);
+      bool empty = true;
+      for (uint32_t i = 0; i < 16; ++i) {
+        empty &= programMemory[row + i] == 0;
+        sum += programMemory[row + i];
+      }
+      if (empty) {
+        continue;
+      }
+      out << "    \":10" << std::setw(4) << row << "00";
+      for (uint32_t i = 0; i < 16; ++i) {
+        out << std::setw(2) << static_cast<int>(programMemory[row + i]);
+      }
+      out << std::setw(2) << static_cast<int>(static_cast<uint8_t>(-sum))
+          << "\\n\"\n";
+    }
+    out << "    \":00000001FF\\n\";\n\n";
+
+    out << "struct StaticProgram {\n"
+        << "  typedef Intel8051::DecodedInstruction Insn;\n\n"
+        << "  // Same contract as Intel8051::run()\n"
+        << "  static void run(Intel8051 &c, uint64_t maxCycles) {\n";
+    std::vector<bool> declared(sizeof(programMemory), false);
+    for (uint16_t start : starts) {
+      uint16_t addr = start;
+      for (uint32_t count = 0; count < maxBlockLength; ++count) {
+        const DecodedInstruction &insn = decodeCache[addr];
+        if (!declared[addr]) {
+          declared[addr] = true;
+          out << "    static const Insn i" << std::setw(4) << addr
+              << " = {&Intel8051::" << opcodeHandlerNames[insn.opcode]
+              << ", 0x" << std::setw(4) << insn.target << ", 0x"
+              << std::setw(2) << static_cast<int>(insn.opcode) << ", 0x"
+              << std::setw(2) << static_cast<int>(insn.operand1) << ", 0x"
+              << std::setw(2) << static_cast<int>(insn.operand2) << ", "
+              << std::dec << static_cast<int>(insn.length) << ", "
+              << static_cast<int>(insn.cycles) << std::hex << "};\n";
+        }
+        addr += insn.length;
+        if (endsBlock(insn)) {
+          break;
+        }
+      }
+    }
 
-    case 0xF3: // MOVX @R1, A
-      writeExternalRAM(readRegister(1), A);
-      cycleCount += 2;
-      break;
+    out << "\n    c.syncDecodeCache();\n"
+        << "    c.beginRun(maxCycles);\n\n"
+        << "  dispatch:\n"
+        << "    if (!c.running ||\n"
+        << "        (c.cycleCount >= c.endCycle && !c.continueRun())) {\n"
+        << "      return;\n"
+        << "    }\n"
+        << "    switch (c.PC) {\n";
+    for (uint16_t start : starts) {
+      out << "    case 0x" << std::setw(4) << start << ":\n"
+          << "      goto b" << std::setw(4) << start << ";\n";
+    }
+    out << "    default:\n"
+        << "      c.executeSwitch();\n"
+        << "      goto dispatch;\n"
+        << "    }\n";
+
+    for (uint16_t start : starts) {
+      // Cycles of the whole block, for the budget check on entry
+      uint32_t cycles = 0;
+      uint16_t addr = start;
+      for (uint32_t count = 0; count < maxBlockLength; ++count) {
+        const DecodedInstruction &insn = decodeCache[addr];
+        cycles += insn.cycles;
+        addr += insn.length;
+        if (endsBlock(insn)) {
+          break;
+        }
+      }
 
-    case 0xF4: // CPL A
-      A = ~A;
-      updateParity();
-      cycleCount += 1;
-      break;
+      uint32_t later = cycles;
+      addr = start;
+      std::ostringstream body;
+      body << std::hex << std::uppercase << std::setfill('0');
+      for (uint32_t count = 0; count < maxBlockLength; ++count) {
+        const DecodedInstruction &insn = decodeCache[addr];
+        later -= insn.cycles;
+        addr += insn.length;
+        body << "    c.PC = 0x" << std::setw(4) << addr << ";\n"
+             << "    c.cycleCount += " << std::dec
+             << static_cast<uint32_t>(insn.cycles) << std::hex << ";\n"
+             << "    c." << opcodeHandlerNames[insn.opcode] << "(i"
+             << std::setw(4) << static_cast<uint16_t>(addr - insn.length)
+             << ");\n";
+        if (endsBlock(insn)) {
+          break;
+        }
+        if (writesIndirect(insn.opcode)) {
+          // An SFR written through @Ri can bring the next event forward
+          body << "    if (c.cycleCount + " << std::dec << later << std::hex
+               << " > c.endCycle) {\n"
+               << "      goto dispatch;\n"
+               << "    }\n";
+        }
+      }
 
-    case 0xF5: // MOV direct, A
-    {
-      uint8_t addr = fetch();
-      writeDataMemory(addr, A);
-      cycleCount += 1;
-      break;
+      out << "\n  b" << std::setw(4) << start << ":\n"
+          << "    if (!c.running || c.cycleCount >= c.endCycle) {\n"
+          << "      goto dispatch;\n"
+          << "    }\n"
+          << "    if (c.endCycle - c.cycleCount < " << std::dec << cycles
+          << ") {\n"
+          << "      goto tail;\n"
+          << "    }\n"
+          << std::hex << body.str();
+      for (uint16_t next : successors[start]) {
+        out << "    if (c.PC == 0x" << std::setw(4) << next << ") {\n"
+            << "      goto b" << std::setw(4) << next << ";\n"
+            << "    }\n";
+      }
+      out << "    goto dispatch;\n";
     }
 
-    case 0xF6: // MOV @R0, A
-      writeDataMemory(readRegister(0), A);
-      cycleCount += 1;
-      break;
+    out << "\n    // The budget or the next event ends inside a block: "
+           "finish\n"
+        << "    // instruction by instruction\n"
+        << "  tail:\n"
+        << "    while (c.running) {\n"
+        << "      c.executeSwitch();\n"
+        << "      if (c.cycleCount >= c.endCycle) {\n"
+        << "        goto dispatch;\n"
+        << "      }\n"
+        << "    }\n"
+        << "  }\n"
+        << "};\n\n"
+        << "int main(int argc, char *argv[]) {\n"
+        << "  Intel8051 cpu;\n"
+        << "  cpu.loadHexFromString(programHex);\n"
+        << "  uint64_t cycles = argc > 1 ? std::stoull(argv[1]) : 1000000;\n"
+        << "  StaticProgram::run(cpu, cycles);\n"
+        << "  cpu.printStatus();\n"
+        << "  return 0;\n"
+        << "}\n";
+    out << std::dec << std::nouppercase << std::setfill(' ');
+  }
 
-    case 0xF7: // MOV @R1, A
-      writeDataMemory(readRegister(1), A);
-      cycleCount += 1;
-      break;
+  void stop() { stopRun(StopReason::Stopped); }
 
-    case 0xF8:
-    case 0xF9:
-    case 0xFA:
-    case 0xFB:
-    case 0xFC:
-    case 0xFD:
-    case 0xFE:
-    case 0xFF: // MOV Rn, A
-      writeRegister(opcode & 0x07, A);
-      cycleCount += 1;
-      break;
+  StopReason getStopReason() const { return stopReason; }
 
-    default:
-      std::cerr << "Warning: Unimplemented opcode 0x" << std::hex
-                << std::setw(2) << std::setfill('0') << (int)opcode
-                << " at PC=0x" << std::setw(4) << (PC - 1) << std::dec
-                << std::endl;
-      cycleCount += 1;
-      break;
-    }
+  // Like run(), but also returns at the first of the given events (bit n
+  // for StopReason n). Halting and waiting for input always end a run.
+  StopReason runUntil(uint64_t maxCycles, uint32_t events) {
+    stopEvents = events;
+    run(maxCycles);
+    stopEvents = 0;
+    return stopReason;
   }
 
-  void run(uint64_t maxCycles = 0) {
-    running = true;
-    uint64_t startCycle = cycleCount;
-
-    while (running) {
-      executeInstruction();
+  // Runs until the current subroutine returns to its caller
+  StopReason stepOut(uint64_t maxCycles) {
+    returnDepth = callDepth;
+    run(maxCycles);
+    returnDepth = INT32_MIN;
+    return stopReason;
+  }
 
-      if (maxCycles > 0 && (cycleCount - startCycle) >= maxCycles) {
-        break;
-      }
+  // Steps one instruction, or runs a whole subroutine when that instruction
+  // calls one
+  StopReason stepOver(uint64_t maxCycles) {
+    syncDecodeCache();
+    const DecodedInstruction &insn = decodeCache[PC];
+    if (((insn.opcode & 0x1F) == 0x11 || insn.opcode == 0x12) &&
+        !isSystemCall(insn.target)) {
+      returnDepth = callDepth + 1;
+      run(maxCycles);
+      returnDepth = INT32_MIN;
+      return stopReason;
     }
+    step();
+    if (stopReason == StopReason::CycleLimit) {
+      stopReason = StopReason::StepComplete;
+    }
+    return stopReason;
   }
 
-  void step() { executeInstruction(); }
-
-  void stop() { running = false; }
+  // Runs until PC reaches address. Like a breakpoint, it is not checked
+  // before the first instruction.
+  StopReason runTo(uint16_t address, uint64_t maxCycles) {
+    bool breakpointSet = isBreakpoint(address);
+    setBreakpoint(address, true);
+    run(maxCycles);
+    setBreakpoint(address, breakpointSet);
+    if (stopReason == StopReason::Breakpoint && PC == address) {
+      stopReason = StopReason::StepComplete;
+    }
+    return stopReason;
+  }
 
   // Register custom system call addresses
   void registerSystemCall(uint16_t address, const std::string &name) {
-    if (name == "WRITE_TEXT") {
-      systemCalls[address] = [this]() { syscall_WRITE_TEXT(); };
-    } else if (name == "WRITE_DATA") {
-      systemCalls[address] = [this]() { syscall_WRITE_DATA(); };
-    } else if (name == "WRITE_HEX") {
-      systemCalls[address] = [this]() { syscall_WRITE_HEX(); };
-    } else if (name == "WRITE_INSTR") {
-      systemCalls[address] = [this]() { syscall_WRITE_INSTR(); };
-    } else if (name == "LCD_INIT") {
-      systemCalls[address] = [this]() { syscall_LCD_INIT(); };
-    } else if (name == "LCD_OFF") {
-      systemCalls[address] = [this]() { syscall_LCD_OFF(); };
-    } else if (name == "LCD_CLR") {
-      systemCalls[address] = [this]() { syscall_LCD_CLR(); };
-    } else if (name == "DELAY_US") {
-      systemCalls[address] = [this]() { syscall_DELAY_US(); };
-    } else if (name == "DELAY_MS") {
-      systemCalls[address] = [this]() { syscall_DELAY_MS(); };
-    } else if (name == "DELAY_100MS") {
-      systemCalls[address] = [this]() { syscall_DELAY_100MS(); };
-    } else if (name == "WAIT_ENTER") {
-      systemCalls[address] = [this]() { syscall_WAIT_ENTER(); };
-    } else if (name == "WAIT_ENTER_NW") {
-      systemCalls[address] = [this]() { syscall_WAIT_ENTER_NW(); };
-    } else if (name == "TEST_ENTER") {
-      systemCalls[address] = [this]() { syscall_TEST_ENTER(); };
-    } else if (name == "WAIT_ENT_ESC") {
-      systemCalls[address] = [this]() { syscall_WAIT_ENT_ESC(); };
-    } else if (name == "WAIT_KEY") {
-      systemCalls[address] = [this]() { syscall_WAIT_KEY(); };
-    } else if (name == "GET_NUM") {
-      systemCalls[address] = [this]() { syscall_GET_NUM(); };
-    } else if (name == "BCD_HEX") {
-      systemCalls[address] = [this]() { syscall_BCD_HEX(); };
-    } else if (name == "HEX_BCD") {
-      systemCalls[address] = [this]() { syscall_HEX_BCD(); };
-    } else if (name == "MUL_2_2") {
-      systemCalls[address] = [this]() { syscall_MUL_2_2(); };
-    } else if (name == "MUL_3_1") {
-      systemCalls[address] = [this]() { syscall_MUL_3_1(); };
-    } else if (name == "DIV_2_1") {
-      systemCalls[address] = [this]() { syscall_DIV_2_1(); };
-    } else if (name == "DIV_4_2") {
-      systemCalls[address] = [this]() { syscall_DIV_4_2(); };
+    for (uint32_t i = 0; i < systemCallCount; i++) {
+      if (name != systemCallNames[i]) {
+        continue;
+      }
+      if (customSystemCallMap.empty()) {
+        customSystemCallMap.assign(defaultSystemCallMap,
+                                   defaultSystemCallMap + 1024);
+        systemCallMap = customSystemCallMap.data();
+      }
+      customSystemCallMap[address >> 6] |= uint64_t(1) << (address & 63);
+      customSystemCalls.erase(
+          std::remove_if(customSystemCalls.begin(), customSystemCalls.end(),
+                         [address](const std::pair<uint16_t, SystemCall> &c) {
+                           return c.first == address;
+                         }),
+          customSystemCalls.end());
+      customSystemCalls.push_back(
+          std::make_pair(address, systemCallRoutines[i]));
     }
     std::cout << "Registered system call '" << name << "' at 0x" << std::hex
               << std::setw(4) << std::setfill('0') << address << std::dec
@@ -2149,7 +4935,7 @@ public:
     std::cout << "A:    0x" << std::setw(2) << (int)A << std::endl;
     std::cout << "B:    0x" << std::setw(2) << (int)B << std::endl;
     std::cout << "DPTR: 0x" << std::setw(4) << DPTR << std::endl;
-    std::cout << "PSW:  0x" << std::setw(2) << (int)PSW
+    std::cout << "PSW:  0x" << std::setw(2) << (int)currentPSW()
               << " [CY=" << getCarryFlag() << " AC=" << getAuxCarryFlag()
               << " OV=" << getOverflowFlag() << " P=" << getParityFlag() << "]"
               << std::endl;
@@ -2175,6 +4961,62 @@ public:
   }
 };
 
+const Intel8051::OpHandler Intel8051::opcodeTable[256] = {
+#define INTEL8051_TABLE_ENTRY(code, handler, length, cycles)                   \
+  &Intel8051::handler,
+    INTEL8051_OPCODES(INTEL8051_TABLE_ENTRY)
+#undef INTEL8051_TABLE_ENTRY
+};
+
+const uint8_t Intel8051::opcodeLengths[256] = {
+#define INTEL8051_LENGTH_ENTRY(code, handler, length, cycles) length,
+    INTEL8051_OPCODES(INTEL8051_LENGTH_ENTRY)
+#undef INTEL8051_LENGTH_ENTRY
+};
+
+const uint8_t Intel8051::opcodeCycles[256] = {
+#define INTEL8051_CYCLES_ENTRY(code, handler, length, cycles) cycles,
+    INTEL8051_OPCODES(INTEL8051_CYCLES_ENTRY)
+#undef INTEL8051_CYCLES_ENTRY
+};
+
+const uint8_t Intel8051::arithmeticFlags[32] = {
+#define INTEL8051_FLAGS_ENTRY(n) arithmeticFlagsEntry(n),
+    INTEL8051_REPEAT16(INTEL8051_FLAGS_ENTRY, 0)
+    INTEL8051_REPEAT16(INTEL8051_FLAGS_ENTRY, 16)
+#undef INTEL8051_FLAGS_ENTRY
+};
+
+const uint16_t Intel8051::decimalAdjust[1024] = {
+#define INTEL8051_DA_ENTRY(n) decimalAdjustEntry(n),
+    INTEL8051_REPEAT1024(INTEL8051_DA_ENTRY, 0)
+#undef INTEL8051_DA_ENTRY
+};
+
+const Intel8051::SystemCall Intel8051::systemCallRoutines[systemCallCount] = {
+#define INTEL8051_ROUTINE_ENTRY(name) &Intel8051::syscall_##name,
+    INTEL8051_SYSTEM_CALLS(INTEL8051_ROUTINE_ENTRY)
+#undef INTEL8051_ROUTINE_ENTRY
+};
+
+const char *const Intel8051::systemCallNames[systemCallCount] = {
+#define INTEL8051_SYSCALL_NAME_ENTRY(name) #name,
+    INTEL8051_SYSTEM_CALLS(INTEL8051_SYSCALL_NAME_ENTRY)
+#undef INTEL8051_SYSCALL_NAME_ENTRY
+};
+
+const uint64_t Intel8051::defaultSystemCallMap[1024] = {
+#define INTEL8051_SYSCALL_MAP_ENTRY(n) systemCallMapEntry(n),
+    INTEL8051_REPEAT1024(INTEL8051_SYSCALL_MAP_ENTRY, 0)
+#undef INTEL8051_SYSCALL_MAP_ENTRY
+};
+
+const char *const Intel8051::opcodeHandlerNames[256] = {
+#define INTEL8051_NAME_ENTRY(code, handler, length, cycles) #handler,
+    INTEL8051_OPCODES(INTEL8051_NAME_ENTRY)
+#undef INTEL8051_NAME_ENTRY
+};
+
 extern "C" {
 
 Intel8051 *emulator_create() { return new Intel8051(); }
@@ -2215,6 +5057,123 @@ size_t emulator_read_output(Intel8051 *cpu, char *buffer, size_t maxLen) {
   return cpu->readOutput(buffer, maxLen);
 }
 
+// Queues up to length bytes for the program's serial receiver and returns
+// how many were taken; the rest does not fit until the program reads more.
+// The receiver picks them up when the next run or step starts.
+size_t emulator_push_serial(Intel8051 *cpu, const uint8_t *data,
+                            size_t length) {
+  if (!cpu || !data) {
+    return 0;
+  }
+  return cpu->pushSerialInput(data, length);
+}
+
+// The LCD's visible characters, 16 for the upper line and then 16 for the
+// lower one. They stay at this address; read them with emulator_read_byte.
+const uint8_t *emulator_lcd_screen(Intel8051 *cpu) {
+  if (!cpu) {
+    return nullptr;
+  }
+  return cpu->getLcdScreen();
+}
+
+// Changes whenever the visible LCD characters change, so a display only
+// needs redrawing when this differs from the value it last drew
+uint32_t emulator_lcd_generation(Intel8051 *cpu) {
+  if (!cpu) {
+    return 0;
+  }
+  return cpu->getLcdGeneration();
+}
+
+// Lines changed since the last call: bit 0 the upper, bit 1 the lower
+uint32_t emulator_lcd_take_dirty(Intel8051 *cpu) {
+  if (!cpu) {
+    return 0;
+  }
+  return cpu->takeLcdDirty();
+}
+
+// Cursor position as row * 16 + column, -1 when it is not shown
+int emulator_lcd_cursor(Intel8051 *cpu) {
+  if (!cpu) {
+    return -1;
+  }
+  return cpu->getLcdCursor();
+}
+
+// Six bytes, the segments of each 7-segment digit in the last frame
+const uint8_t *emulator_display_frame(Intel8051 *cpu) {
+  if (!cpu) {
+    return nullptr;
+  }
+  return cpu->getDisplayFrame();
+}
+
+// Finishes the display frames that ended during the last run and returns
+// a generation that changes whenever a frame looks different
+uint32_t emulator_display_generation(Intel8051 *cpu) {
+  if (!cpu) {
+    return 0;
+  }
+  return cpu->pollDisplay();
+}
+
+// Presses (pressed != 0) or releases keypad key 0-15 delay cycles from now
+void emulator_key_event(Intel8051 *cpu, uint32_t key, int pressed,
+                        uint32_t delay) {
+  if (!cpu) {
+    return;
+  }
+  cpu->queueKeyEvent(static_cast<uint8_t>(std::min<uint32_t>(key, 16)),
+                     pressed != 0, cpu->getCycleCount() + delay);
+}
+
+// Records the changes of P0-P3 in a ring of capacity entries, 0 turns the
+// trace off
+void emulator_set_port_trace(Intel8051 *cpu, uint32_t capacity) {
+  if (!cpu) {
+    return;
+  }
+  cpu->setPortTrace(capacity);
+}
+
+// Moves up to maxChanges of the oldest port changes into buffer, as 16-byte
+// PortChange records, and returns how many there were
+uint32_t emulator_drain_port_trace(Intel8051 *cpu, PortChange *buffer,
+                                   uint32_t maxChanges) {
+  if (!cpu || !buffer) {
+    return 0;
+  }
+  return static_cast<uint32_t>(cpu->drainPortTrace(buffer, maxChanges));
+}
+
+// Port changes dropped because the trace was full
+uint32_t emulator_port_trace_lost(Intel8051 *cpu) {
+  if (!cpu) {
+    return 0;
+  }
+  return static_cast<uint32_t>(
+      std::min<uint64_t>(cpu->getPortTraceLost(), UINT32_MAX));
+}
+
+// Sets how many cycles of digit scanning are folded into one frame
+void emulator_set_display_window(Intel8051 *cpu, uint32_t cycles) {
+  if (!cpu) {
+    return;
+  }
+  cpu->setDisplayWindow(cycles);
+}
+
+// Moves up to maxLen bytes the program has sent through SBUF into buffer
+// and returns how many there were
+size_t emulator_read_serial(Intel8051 *cpu, uint8_t *buffer, size_t maxLen) {
+  if (!cpu || !buffer) {
+    return 0;
+  }
+  return cpu->readSerialOutput(buffer, maxLen);
+}
+
 size_t emulator_get_output_size(Intel8051 *cpu) {
   if (!cpu) {
     return 0;
@@ -2250,6 +5209,25 @@ void emulator_run_cycles(Intel8051 *cpu, uint32_t cycles) {
   cpu->run(static_cast<uint64_t>(cycles));
 }
 
+// Runs until the budget is used up (0 = no limit) or one of the events in
+// eventMask happens, where bit n stands for emulator_stop_reason() value n.
+// Halts, input waits, breakpoints and watchpoints end every run.
+// Returns the stop reason and stores the cycles run in *cyclesRun if given,
+// capped at UINT32_MAX for unlimited runs that went further.
+int emulator_run_until(Intel8051 *cpu, uint32_t budget, uint32_t eventMask,
+                       uint32_t *cyclesRun) {
+  if (!cpu) {
+    return 0;
+  }
+  uint64_t start = cpu->getCycleCount();
+  StopReason reason = cpu->runUntil(budget, eventMask);
+  if (cyclesRun) {
+    *cyclesRun = static_cast<uint32_t>(
+        std::min<uint64_t>(cpu->getCycleCount() - start, UINT32_MAX));
+  }
+  return static_cast<int>(reason);
+}
+
 void emulator_step(Intel8051 *cpu) {
   if (!cpu) {
     return;
@@ -2257,6 +5235,47 @@ void emulator_step(Intel8051 *cpu) {
   cpu->step();
 }
 
+// Debugger stepping. Each returns the stop reason, and budget (0 = no
+// limit) bounds how long a subroutine may run.
+int emulator_step_over(Intel8051 *cpu, uint32_t budget) {
+  if (!cpu) {
+    return 0;
+  }
+  return static_cast<int>(cpu->stepOver(budget));
+}
+
+int emulator_step_out(Intel8051 *cpu, uint32_t budget) {
+  if (!cpu) {
+    return 0;
+  }
+  return static_cast<int>(cpu->stepOut(budget));
+}
+
+int emulator_run_to(Intel8051 *cpu, uint32_t address, uint32_t budget) {
+  if (!cpu || address > 0xFFFF) {
+    return 0;
+  }
+  return static_cast<int>(
+      cpu->runTo(static_cast<uint16_t>(address), budget));
+}
+
+// JIT tier of the block engine: 0 = off, 1 = on, 2 = lockstep verification
+void emulator_set_jit_mode(Intel8051 *cpu, int mode) {
+  if (!cpu || mode < 0 || mode > 2) {
+    return;
+  }
+  cpu->setJitMode(static_cast<JitMode>(mode));
+}
+
+int emulator_jit_available() { return Intel8051::jitAvailable() ? 1 : 0; }
+
+uint32_t emulator_jit_mismatches(Intel8051 *cpu) {
+  if (!cpu) {
+    return 0;
+  }
+  return static_cast<uint32_t>(cpu->getJitMismatchCount());
+}
+
 void emulator_stop(Intel8051 *cpu) {
   if (!cpu) {
     return;
@@ -2278,6 +5297,71 @@ int emulator_wait_reason(Intel8051 *cpu) {
   return cpu->getWaitTypeCode();
 }
 
+// Why the last run or step returned: 0 = cycle budget used up, 1 = halted
+// in a jump to itself, 2 = waiting for input, from the keypad or, in a jump
+// to itself, through the serial port, 3 = stopped by the host,
+// 4 = new output (emulator_run_until only), 5 = breakpoint, 6 = watchpoint,
+// 7 = step over, step out or run to address done
+int emulator_stop_reason(Intel8051 *cpu) {
+  if (!cpu) {
+    return 0;
+  }
+  return static_cast<int>(cpu->getStopReason());
+}
+
+// A run stops before executing an instruction at a breakpoint, except at
+// the address it starts from
+void emulator_set_breakpoint(Intel8051 *cpu, uint32_t address, int enabled) {
+  if (!cpu || address > 0xFFFF) {
+    return;
+  }
+  cpu->setBreakpoint(static_cast<uint16_t>(address), enabled != 0);
+}
+
+void emulator_clear_breakpoints(Intel8051 *cpu) {
+  if (!cpu) {
+    return;
+  }
+  cpu->clearBreakpoints();
+}
+
+// space: 0 = internal data (RAM and SFRs), 1 = external RAM. access: 1 =
+// read, 2 = write, 3 = both, 0 removes the watchpoint. A run stops after
+// the instruction that made a watched access.
+void emulator_set_watchpoint(Intel8051 *cpu, int space, uint32_t address,
+                             int access) {
+  if (!cpu || space < 0 || space > 1 || address > (space ? 0xFFFFu : 0xFFu)) {
+    return;
+  }
+  cpu->setWatchpoint(space == 1, static_cast<uint16_t>(address),
+                     static_cast<uint8_t>(access));
+}
+
+void emulator_clear_watchpoints(Intel8051 *cpu) {
+  if (!cpu) {
+    return;
+  }
+  cpu->clearWatchpoints();
+}
+
+// Last watchpoint hit: address in bits 0-15, space in bit 16 and access in
+// bits 17-18
+uint32_t emulator_watch_hit(Intel8051 *cpu) {
+  if (!cpu) {
+    return 0;
+  }
+  return cpu->getWatchHitAddress() | (cpu->getWatchHitExternal() << 16) |
+         (cpu->getWatchHitAccess() << 17);
+}
+
+// Address of the instruction that made the last watchpoint hit
+uint32_t emulator_watch_hit_pc(Intel8051 *cpu) {
+  if (!cpu) {
+    return 0;
+  }
+  return cpu->getWatchHitPC();
+}
+
 void emulator_get_state(Intel8051 *cpu, EmulatorState *outState) {
   if (!cpu || !outState) {
     return;
@@ -2333,7 +5417,128 @@ uint8_t emulator_read_memory(Intel8051 *cpu, size_t offset) {
 }
 }
 
-#ifndef BUILDING_FOR_WASM
+#if !defined(BUILDING_FOR_WASM) && !defined(INTEL8051_STATIC_PROGRAM)
+template <DispatchEngine engine>
+static double timeDispatchEngine(const std::string &hexData, uint64_t cycles,
+                                 EmulatorState &finalState,
+                                 uint64_t &fastForwarded,
+                                 JitMode jit = JitMode::Off) {
+  Intel8051 cpu;
+  cpu.setOutputOptions(false, false);
+  cpu.setJitMode(jit);
+  cpu.loadHexFromString(hexData);
+
+  auto start = std::chrono::steady_clock::now();
+  cpu.runEngine<engine>(cycles);
+  auto end = std::chrono::steady_clock::now();
+
+  cpu.getStateSnapshot(finalState);
+  fastForwarded = cpu.getFastForwarded();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+// Runs the loaded program for the given number of cycles on every dispatch
+// engine and reports emulated MIPS, using the switch engine as the baseline.
+static void runDispatchBenchmark(const std::string &filename,
+                                 uint64_t cycles) {
+  std::ifstream file(filename);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  std::string hexData = contents.str();
+
+  // Count instructions once; every engine executes exactly the same stream.
+  // Stepping never fast-forwards, so busy-wait loops are counted in full.
+  Intel8051 counter;
+  counter.setOutputOptions(false, false);
+  counter.loadHexFromString(hexData);
+  uint64_t instructions = 0;
+  while (counter.getCycleCount() < cycles && !counter.isWaitingForInput()) {
+    counter.step();
+    instructions++;
+  }
+
+  struct Result {
+    const char *name;
+    double seconds;
+    EmulatorState state;
+    uint64_t fastForwarded; // Counted above but never run by the engine
+  };
+  Result results[5] = {{"switch", 0, {}, 0},
+                       {"table", 0, {}, 0},
+                       {"threaded", 0, {}, 0},
+                       {"block", 0, {}, 0},
+                       {"jit", 0, {}, 0}};
+  results[0].seconds = timeDispatchEngine<DispatchEngine::Switch>(
+      hexData, cycles, results[0].state, results[0].fastForwarded);
+  results[1].seconds = timeDispatchEngine<DispatchEngine::Table>(
+      hexData, cycles, results[1].state, results[1].fastForwarded);
+  results[2].seconds = timeDispatchEngine<DispatchEngine::Threaded>(
+      hexData, cycles, results[2].state, results[2].fastForwarded);
+  results[3].seconds = timeDispatchEngine<DispatchEngine::Block>(
+      hexData, cycles, results[3].state, results[3].fastForwarded);
+  results[4].seconds = timeDispatchEngine<DispatchEngine::Block>(
+      hexData, cycles, results[4].state, results[4].fastForwarded,
+      JitMode::On);
+
+  std::cout << "\nDispatch benchmark: " << cycles << " cycles, "
+            << instructions << " instructions";
+  if (results[0].fastForwarded > 0) {
+    std::cout << " (" << results[0].fastForwarded
+              << " of them fast-forwarded busy-wait iterations, not timed)";
+  }
+  std::cout << std::endl;
+  for (const Result &result : results) {
+    if (result.name == std::string("jit") && !Intel8051::jitAvailable()) {
+      continue;
+    }
+    // MIPS of the instructions the engine actually ran
+    double mips =
+        (instructions - result.fastForwarded) / result.seconds / 1e6;
+    double speedup = results[0].seconds / result.seconds;
+    const EmulatorState &a = result.state;
+    const EmulatorState &b = results[0].state;
+    bool matches = a.cycles == b.cycles && a.pc == b.pc && a.dptr == b.dptr &&
+                   a.sp == b.sp && a.a == b.a && a.b == b.b &&
+                   a.psw == b.psw && a.p0 == b.p0 && a.p1 == b.p1 &&
+                   a.p2 == b.p2 && a.p3 == b.p3;
+    std::cout << "  " << std::left << std::setw(10) << result.name
+              << std::right << std::fixed << std::setprecision(3)
+              << result.seconds << " s  " << std::setw(8)
+              << std::setprecision(1) << mips << " MIPS  x"
+              << std::setprecision(2) << speedup
+              << (matches ? "" : "  (STATE MISMATCH)") << std::endl;
+  }
+  std::cout.unsetf(std::ios::fixed);
+}
+
+// Writes traced port changes as a VCD waveform with one 8-bit signal per
+// port, starting from the values the ports have after reset. Time is in
+// machine cycles, shown as 1 us each.
+static void writePortVcd(std::ostream &out,
+                         const std::vector<PortChange> &changes) {
+  out << "$timescale 1 us $end\n";
+  out << "$scope module dsm51 $end\n";
+  for (int port = 0; port < 4; ++port) {
+    out << "$var wire 8 " << char('!' + port) << " P" << port << " $end\n";
+  }
+  out << "$upscope $end\n$enddefinitions $end\n";
+  out << "#0\n$dumpvars\n";
+  for (int port = 0; port < 4; ++port) {
+    out << "b11111111 " << char('!' + port) << "\n";
+  }
+  out << "$end\n";
+
+  uint64_t time = 0;
+  for (const PortChange &change : changes) {
+    if (change.cycle != time) {
+      time = change.cycle;
+      out << "#" << time << "\n";
+    }
+    out << "b" << std::bitset<8>(change.value) << " "
+        << char('!' + change.port) << "\n";
+  }
+}
+
 int main(int argc, char *argv[]) {
   std::cout << "8051 Emulator v1.0" << std::endl;
   std::cout << "==================" << std::endl;
@@ -2346,6 +5551,17 @@ int main(int argc, char *argv[]) {
               << std::endl;
     std::cerr << "  -d <addr> <len> : Dump memory from address for length bytes"
               << std::endl;
+    std::cerr << "  -b <cycles>  : Benchmark the dispatch engines for n cycles"
+              << std::endl;
+    std::cerr << "  -j           : Compile hot code to native code (x86-64)"
+              << std::endl;
+    std::cerr << "  -jv          : JIT with lockstep verification against the "
+                 "interpreter"
+              << std::endl;
+    std::cerr << "  -c <file>    : Translate the program to a C++ source file"
+              << std::endl;
+    std::cerr << "  -t <file>    : Write the port changes of -r to a VCD file"
+              << std::endl;
     return 1;
   }
 
@@ -2359,6 +5575,7 @@ int main(int argc, char *argv[]) {
   // Process command line options
   bool autoRun = false;
   uint64_t runCycles = 1000000; // Default: 1 million cycles
+  std::string vcdFile;
 
   for (int i = 2; i < argc; i++) {
     std::string arg = argv[i];
@@ -2378,14 +5595,70 @@ int main(int argc, char *argv[]) {
       uint16_t addr = std::stoul(argv[++i], nullptr, 16);
       uint16_t len = std::stoul(argv[++i], nullptr, 10);
       cpu.dumpMemory(addr, len, true);
+    } else if (arg == "-b" && i + 1 < argc) {
+      runDispatchBenchmark(argv[1], std::stoull(argv[++i]));
+      return 0;
+    } else if (arg == "-c" && i + 1 < argc) {
+      std::ofstream out(argv[++i]);
+      if (!out) {
+        std::cerr << "Error: Could not write " << argv[i] << std::endl;
+        return 1;
+      }
+      cpu.writeStaticProgram(out, argv[1]);
+      std::cout << "Wrote " << argv[i] << std::endl;
+      return 0;
+    } else if (arg == "-j" || arg == "-jv") {
+      if (!Intel8051::jitAvailable()) {
+        std::cerr << "Warning: JIT is not available in this build" << std::endl;
+      }
+      cpu.setJitMode(arg == "-j" ? JitMode::On : JitMode::Lockstep);
+    } else if (arg == "-t" && i + 1 < argc) {
+      vcdFile = argv[++i];
     }
   }
 
   if (autoRun) {
     std::cout << "\nRunning emulator for " << runCycles << " cycles..."
               << std::endl;
-    cpu.run(runCycles);
+    if (vcdFile.empty()) {
+      cpu.run(runCycles);
+    } else {
+      // Run in slices and drain the trace after each, so it never fills up
+      const uint32_t traceCapacity = 1 << 16;
+      std::vector<PortChange> changes;
+      std::vector<PortChange> drained(traceCapacity);
+      cpu.setPortTrace(traceCapacity);
+      uint64_t start = cpu.getCycleCount();
+      uint64_t done = 0;
+      do {
+        cpu.run(runCycles == 0
+                    ? traceCapacity
+                    : std::min<uint64_t>(runCycles - done, traceCapacity));
+        done = cpu.getCycleCount() - start;
+        size_t count = cpu.drainPortTrace(drained.data(), drained.size());
+        changes.insert(changes.end(), drained.begin(),
+                       drained.begin() + count);
+      } while (cpu.getStopReason() == StopReason::CycleLimit &&
+               (runCycles == 0 || done < runCycles));
+
+      std::ofstream out(vcdFile);
+      if (!out) {
+        std::cerr << "Error: Could not write " << vcdFile << std::endl;
+        return 1;
+      }
+      writePortVcd(out, changes);
+      std::cout << "Wrote " << changes.size() << " port changes to "
+                << vcdFile << std::endl;
+    }
+    if (cpu.getStopReason() == StopReason::Halted) {
+      std::cout << "Program halted in a jump to itself" << std::endl;
+    }
     cpu.printStatus();
+    if (cpu.getJitMismatchCount() > 0) {
+      std::cerr << "JIT lockstep mismatches: " << cpu.getJitMismatchCount()
+                << std::endl;
+      return 1;
+    }
   } else {
     // Interactive mode¬
     std::cout << "\nEntering interactive mode. Commands:" << std::endl;
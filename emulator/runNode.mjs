@@ -0,0 +1,128 @@
+// Headless runner for the browser build. Runs a HEX file on emulator.wasm
+// with the WebAssembly JIT off and on and checks that both end in the same
+// state, so the JIT can be tested without a browser:
+//
+//   node runNode.mjs <hexfile> [cycles] [--lockstep]
+//
+// --lockstep also replays every translated block on the interpreter inside
+// the module and fails on any difference. Rebuild with ./buildWeb first.
+import { readFileSync } from "fs";
+import { createRequire } from "module";
+import { dirname, join } from "path";
+import { fileURLToPath } from "url";
+
+const here = dirname(fileURLToPath(import.meta.url));
+const assets = join(here, "../frontend/public/assets");
+
+// emulator.js is a CommonJS/UMD script, but frontend/package.json makes .js
+// files there ES modules, so evaluate it with a CommonJS wrapper instead.
+function loadEmulatorFactory() {
+  const filename = join(assets, "emulator.js");
+  const exported = { exports: {} };
+  new Function("module", "exports", "require", "__dirname", "__filename",
+    readFileSync(filename, "utf8"))(
+    exported,
+    exported.exports,
+    createRequire(filename),
+    assets,
+    filename
+  );
+  return exported.exports;
+}
+const createEmulatorModule = loadEmulatorFactory();
+
+const args = process.argv.slice(2).filter((arg) => !arg.startsWith("--"));
+const lockstep = process.argv.includes("--lockstep");
+if (args.length < 1) {
+  console.error("Usage: node runNode.mjs <hexfile> [cycles] [--lockstep]");
+  process.exit(1);
+}
+const hex = readFileSync(args[0], "utf8");
+const totalCycles = Number(args[1] ?? 10000000);
+const chunkCycles = 100000;
+
+const emu = await createEmulatorModule({
+  locateFile: (path) => join(assets, path),
+  print: () => {},
+});
+const api = {
+  create: emu.cwrap("emulator_create", "number", []),
+  destroy: emu.cwrap("emulator_destroy", null, ["number"]),
+  loadHexString: emu.cwrap("emulator_load_hex_string", "number", [
+    "number",
+    "number",
+  ]),
+  setOutputOptions: emu.cwrap("emulator_set_output_options", null, [
+    "number",
+    "number",
+    "number",
+  ]),
+  runCycles: emu.cwrap("emulator_run_cycles", null, ["number", "number"]),
+  stopReason: emu.cwrap("emulator_stop_reason", "number", ["number"]),
+  getState: emu.cwrap("emulator_get_state", null, ["number", "number"]),
+  stateSize: emu.cwrap("emulator_state_size", "number", []),
+  readByte: emu.cwrap("emulator_read_byte", "number", ["number", "number"]),
+};
+
+if (!emu._emulator_set_jit_mode) {
+  console.error("emulator.wasm has no JIT exports, rebuild it with ./buildWeb");
+  process.exit(1);
+}
+const setJitMode = emu.cwrap("emulator_set_jit_mode", null, [
+  "number",
+  "number",
+]);
+const jitMismatches = emu.cwrap("emulator_jit_mismatches", "number", [
+  "number",
+]);
+
+function run(jitMode) {
+  const cpu = api.create();
+  api.setOutputOptions(cpu, 1, 0);
+  setJitMode(cpu, jitMode);
+  const length = emu.lengthBytesUTF8(hex) + 1;
+  const hexPtr = emu._malloc(length);
+  emu.stringToUTF8(hex, hexPtr, length);
+  api.loadHexString(cpu, hexPtr);
+  emu._free(hexPtr);
+
+  const start = performance.now();
+  // Until the budget is spent, the program waits for input or halts
+  for (let done = 0; done < totalCycles && api.stopReason(cpu) === 0; ) {
+    const chunk = Math.min(chunkCycles, totalCycles - done);
+    api.runCycles(cpu, chunk);
+    done += chunk;
+  }
+  const seconds = (performance.now() - start) / 1000;
+
+  const size = api.stateSize();
+  const statePtr = emu._malloc(size);
+  api.getState(cpu, statePtr);
+  const state = Buffer.alloc(size);
+  for (let i = 0; i < size; i++) {
+    state[i] = api.readByte(statePtr, i);
+  }
+  emu._free(statePtr);
+
+  const mismatches = jitMismatches(cpu);
+  api.destroy(cpu);
+  return { seconds, state, mismatches };
+}
+
+const interpreted = run(0);
+const compiled = run(lockstep ? 2 : 1);
+const same = interpreted.state.equals(compiled.state);
+
+console.log(`interpreter ${interpreted.seconds.toFixed(3)} s`);
+console.log(
+  `jit         ${compiled.seconds.toFixed(3)} s  x${(
+    interpreted.seconds / compiled.seconds
+  ).toFixed(2)}`
+);
+if (!same || compiled.mismatches > 0) {
+  console.error(
+    `JIT differs from the interpreter (${compiled.mismatches} lockstep mismatches)`
+  );
+  process.exit(1);
+}
+console.log("Final state matches");
@@ -8,6 +8,7 @@ import { CodeEditor } from "./components/CodeEditor";
 import { HexInput } from "./components/HexInput";
 import { EmulatorControls } from "./components/EmulatorControls";
 import { LCDOutput } from "./components/LCDOutput";
+import { SevenSegmentDisplay } from "./components/SevenSegmentDisplay";
 import { Keypad } from "./components/Keypad";
 import { RAMViewer } from "./components/RAMViewer";
 import { ExternalRAMViewer } from "./components/ExternalRAMViewer";
@@ -31,15 +32,20 @@ function App() {
     emulatorLoaded,
     emulatorStatus,
     emulatorOutput,
+    lcdLines,
+    displayDigits,
     emulatorWaiting,
     emulatorState,
     registerBanks,
     runCycles,
+    jitAvailable,
+    jitEnabled,
     emulatorHex,
     handleEmulatorHexChange,
     loadEmulatorHex,
     handleLoadProgram,
     handleRunCycleChange,
+    handleJitChange,
     handleRun,
     handleStep,
     handleResetEmulator,
@@ -82,7 +88,8 @@ function App() {
         {/* Emulator Section */}
         <div className="flex flex-col lg:flex-row gap-6">
           <div className="space-y-4 w-full lg:w-auto">
-            <LCDOutput emulatorOutput={emulatorOutput} />
+            <LCDOutput emulatorOutput={emulatorOutput} lcdLines={lcdLines} />
+            {displayDigits && <SevenSegmentDisplay digits={displayDigits} />}
             <Keypad
               onKeyPress={handleKeypad}
               disabled={!emulatorReady || !emulatorLoaded}
@@ -96,6 +103,9 @@ function App() {
               emulatorReady={emulatorReady}
               emulatorLoaded={emulatorLoaded}
               onRunCycleChange={handleRunCycleChange}
+              jitAvailable={jitAvailable}
+              jitEnabled={jitEnabled}
+              onJitChange={handleJitChange}
               onRun={handleRun}
               onStep={handleStep}
               onResetEmulator={handleResetEmulator}
@@ -5,6 +5,9 @@ interface EmulatorControlsProps {
   emulatorReady: boolean;
   emulatorLoaded: boolean;
   onRunCycleChange: (value: string) => void;
+  jitAvailable: boolean;
+  jitEnabled: boolean;
+  onJitChange: (enabled: boolean) => void;
   onRun: () => void;
   onStep: () => void;
   onResetEmulator: () => void;
@@ -17,6 +20,9 @@ export function EmulatorControls({
   emulatorReady,
   emulatorLoaded,
   onRunCycleChange,
+  jitAvailable,
+  jitEnabled,
+  onJitChange,
   onRun,
   onStep,
   onResetEmulator,
@@ -70,6 +76,17 @@ export function EmulatorControls({
             />
           </div>
 
+          {jitAvailable && (
+            <label className="flex items-center gap-2 text-xs text-gray-600">
+              <input
+                type="checkbox"
+                checked={jitEnabled}
+                onChange={(e) => onJitChange(e.target.checked)}
+              />
+              Compile hot loops (JIT)
+            </label>
+          )}
+
           <div className="bg-gray-50 p-2 rounded border">
             <p className="text-xs text-gray-600">{emulatorStatus}</p>
           </div>
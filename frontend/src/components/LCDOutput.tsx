@@ -1,8 +1,10 @@
 interface LCDOutputProps {
   emulatorOutput: string;
+  // Controller framebuffer, when the emulator build models the LCD
+  lcdLines?: string[] | null;
 }
 
-export function LCDOutput({ emulatorOutput }: LCDOutputProps) {
+export function LCDOutput({ emulatorOutput, lcdLines }: LCDOutputProps) {
   // Format LCD output to display max 2 lines of 16 chars each
   const formatLCDOutput = (text: string): string => {
     if (!text || typeof text !== 'string') return "";
@@ -21,9 +23,11 @@ export function LCDOutput({ emulatorOutput }: LCDOutputProps) {
     }
   };
 
-  const displayText = emulatorOutput 
-    ? formatLCDOutput(emulatorOutput)
-    : "";
+  const displayText = lcdLines
+    ? lcdLines.join('\n')
+    : emulatorOutput
+      ? formatLCDOutput(emulatorOutput)
+      : "";
 
   return (
     <div className="bg-white rounded-lg shadow p-4">
@@ -0,0 +1,44 @@
+interface SevenSegmentDisplayProps {
+  // Segments of each digit, bit 0 for segment a to bit 7 for the point
+  digits: number[];
+}
+
+// Segment outlines in a 12x20 box, in bit order a to g
+const SEGMENT_POINTS = [
+  "2,1 10,1 9,2.5 3,2.5",
+  "10.5,1.5 10.5,9.5 9,8.5 9,2.5",
+  "10.5,10.5 10.5,18.5 9,17.5 9,11.5",
+  "2,19 10,19 9,17.5 3,17.5",
+  "1.5,10.5 1.5,18.5 3,17.5 3,11.5",
+  "1.5,1.5 1.5,9.5 3,8.5 3,2.5",
+  "2,10 3,9.2 9,9.2 10,10 9,10.8 3,10.8",
+];
+
+function Digit({ segments }: { segments: number }) {
+  const color = (bit: number) =>
+    segments & (1 << bit) ? "#ef4444" : "#3f1d1d";
+  return (
+    <svg viewBox="0 0 14 20" className="h-14 w-10">
+      {SEGMENT_POINTS.map((points, bit) => (
+        <polygon key={bit} points={points} fill={color(bit)} />
+      ))}
+      <circle cx="12.5" cy="18.5" r="1" fill={color(7)} />
+    </svg>
+  );
+}
+
+export function SevenSegmentDisplay({ digits }: SevenSegmentDisplayProps) {
+  return (
+    <div className="bg-white rounded-lg shadow p-4">
+      <h3 className="text-base font-semibold text-gray-700 mb-3">
+        7-Segment Display
+      </h3>
+      <div className="bg-gray-950 p-3 rounded border-4 border-gray-800 flex gap-1 justify-center">
+        {/* Digit 0 is the rightmost one */}
+        {[...digits].reverse().map((segments, index) => (
+          <Digit key={index} segments={segments} />
+        ))}
+      </div>
+    </div>
+  );
+}
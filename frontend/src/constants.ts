@@ -27,6 +27,12 @@ export const WAIT_REASON_MAP: Record<number, string> = {
   5: "Enter a 4-digit number",
 };
 
+// emulator_stop_reason() after a program ends in a jump to itself
+export const STOP_REASON_HALTED = 1;
+// ...or when it waits for input: in a system call, or in a jump to itself
+// for a serial interrupt
+export const STOP_REASON_WAITING = 2;
+
 export const DEFAULT_ASM_CODE = `; DSM51 Assembly Example
     MOV A, #25
     MOV R0, A
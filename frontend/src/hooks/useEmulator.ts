@@ -1,6 +1,10 @@
 import { useState, useEffect, useRef, useCallback } from "react";
 import type { EmulatorApi, EmulatorSnapshot, EmulatorStateOffsets } from "../types";
-import { WAIT_REASON_MAP } from "../constants";
+import {
+  STOP_REASON_HALTED,
+  STOP_REASON_WAITING,
+  WAIT_REASON_MAP,
+} from "../constants";
 
 export function useEmulator() {
   const [emulatorReady, setEmulatorReady] = useState(false);
@@ -9,12 +13,16 @@ export function useEmulator() {
     "Loading emulator module..."
   );
   const [emulatorOutput, setEmulatorOutput] = useState("");
+  const [lcdLines, setLcdLines] = useState<string[] | null>(null);
+  const [displayDigits, setDisplayDigits] = useState<number[] | null>(null);
   const [emulatorWaiting, setEmulatorWaiting] = useState<string | null>(null);
   const [emulatorState, setEmulatorState] = useState<EmulatorSnapshot | null>(
     null
   );
   const [registerBanks, setRegisterBanks] = useState<Uint8Array | null>(null);
   const [runCycles, setRunCycles] = useState(1000);
+  // The WebAssembly JIT is opt-in: off until the user turns it on
+  const [jitEnabled, setJitEnabled] = useState(false);
   const [emulatorHex, setEmulatorHex] = useState("");
 
   // eslint-disable-next-line @typescript-eslint/no-explicit-any
@@ -24,6 +32,9 @@ export function useEmulator() {
   const emulatorScriptLoaded = useRef(false);
   const emulatorStateOffsetsRef = useRef<EmulatorStateOffsets | null>(null);
   const emulatorHexTouched = useRef(false);
+  const lcdGenerationRef = useRef(-1);
+  const lcdLinesRef = useRef<string[] | null>(null);
+  const displayGenerationRef = useRef(-1);
 
   useEffect(() => {
     if (emulatorScriptLoaded.current) {
@@ -120,14 +131,47 @@ export function useEmulator() {
             "number",
           ]),
           runCycles: wrap("emulator_run_cycles", null, ["number", "number"]),
+          runUntil: wrap("emulator_run_until", "number", [
+            "number",
+            "number",
+            "number",
+            "number",
+          ]),
           step: wrap("emulator_step", null, ["number"]),
+          setJitMode: module._emulator_set_jit_mode
+            ? wrap("emulator_set_jit_mode", null, ["number", "number"])
+            : undefined,
           isWaiting: wrap("emulator_is_waiting", "number", ["number"]),
           waitReason: wrap("emulator_wait_reason", "number", ["number"]),
+          stopReason: wrap("emulator_stop_reason", "number", ["number"]),
           getState: wrap("emulator_get_state", null, ["number", "number"]),
           stateSize: wrap("emulator_state_size", "number", []),
           stateOffset: wrap("emulator_state_offset", "number", ["number"]),
           readByte: wrap("emulator_read_byte", "number", ["number", "number"]),
           readMemory: wrap("emulator_read_memory", "number", ["number", "number"]),
+          lcdScreen: module._emulator_lcd_screen
+            ? wrap("emulator_lcd_screen", "number", ["number"])
+            : undefined,
+          lcdGeneration: module._emulator_lcd_generation
+            ? wrap("emulator_lcd_generation", "number", ["number"])
+            : undefined,
+          lcdTakeDirty: module._emulator_lcd_take_dirty
+            ? wrap("emulator_lcd_take_dirty", "number", ["number"])
+            : undefined,
+          displayFrame: module._emulator_display_frame
+            ? wrap("emulator_display_frame", "number", ["number"])
+            : undefined,
+          displayGeneration: module._emulator_display_generation
+            ? wrap("emulator_display_generation", "number", ["number"])
+            : undefined,
+          keyEvent: module._emulator_key_event
+            ? wrap("emulator_key_event", null, [
+                "number",
+                "number",
+                "number",
+                "number",
+              ])
+            : undefined,
         };
 
         const instancePtr = api.create();
@@ -226,6 +270,65 @@ export function useEmulator() {
     }
   }
 
+  // Reads back only the LCD lines that changed since the last pull
+  function pullLcd() {
+    const context = getEmulatorContext();
+    if (!context) {
+      return;
+    }
+    const { api, instance } = context;
+    if (!api.lcdScreen || !api.lcdGeneration || !api.lcdTakeDirty) {
+      return;
+    }
+    const generation = api.lcdGeneration(instance);
+    if (generation === lcdGenerationRef.current) {
+      return;
+    }
+    lcdGenerationRef.current = generation;
+
+    const previous = lcdLinesRef.current;
+    const dirty = api.lcdTakeDirty(instance) | (previous ? 0 : 3);
+    const screen = api.lcdScreen(instance);
+    const lines = previous ? [...previous] : ["", ""];
+    for (let line = 0; line < 2; ++line) {
+      if (!(dirty & (1 << line))) {
+        continue;
+      }
+      let text = "";
+      for (let column = 0; column < 16; ++column) {
+        const code = api.readByte(screen, line * 16 + column);
+        text += code >= 0x20 && code < 0x7f ? String.fromCharCode(code) : " ";
+      }
+      lines[line] = text;
+    }
+    lcdLinesRef.current = lines;
+    setLcdLines(lines);
+  }
+
+  // Reads back the 7-segment frame when a new one differs from the last
+  function pullDisplay() {
+    const context = getEmulatorContext();
+    if (!context) {
+      return;
+    }
+    const { api, instance } = context;
+    if (!api.displayFrame || !api.displayGeneration) {
+      return;
+    }
+    const generation = api.displayGeneration(instance);
+    if (generation === displayGenerationRef.current) {
+      return;
+    }
+    displayGenerationRef.current = generation;
+
+    const frame = api.displayFrame(instance);
+    const digits: number[] = [];
+    for (let digit = 0; digit < 6; ++digit) {
+      digits.push(api.readByte(frame, digit));
+    }
+    setDisplayDigits(digits);
+  }
+
   function pullEmulatorState() {
     const context = getEmulatorContext();
     if (!context) {
@@ -343,6 +446,8 @@ export function useEmulator() {
     setEmulatorOutput("");
     setEmulatorStatus("HEX program loaded into emulator.");
     setEmulatorWaiting(null);
+    pullLcd();
+    pullDisplay();
     pullEmulatorState();
   }
 
@@ -359,6 +464,15 @@ export function useEmulator() {
     setRunCycles(parsed);
   }
 
+  function handleJitChange(enabled: boolean) {
+    setJitEnabled(enabled);
+    const api = emulatorApiRef.current;
+    const instance = emulatorInstanceRef.current;
+    if (api && instance !== null) {
+      api.setJitMode?.(instance, enabled ? 1 : 0);
+    }
+  }
+
   function handleRun(cycles?: number) {
     const context = getEmulatorContext(true);
     if (!context) {
@@ -376,16 +490,24 @@ export function useEmulator() {
     
     console.log('Running', count, 'cycles');
     setTimeout(() => {
-      console.log('Executing runCycles');
-      api.runCycles(instance, count);
+      console.log('Executing runUntil');
+      const reason = api.runUntil(instance, count, 0, 0);
       console.log('Pulling output');
       pullEmulatorOutput();
+      pullLcd();
+      pullDisplay();
       console.log('Pulling state');
       pullEmulatorState();
       console.log('Updating wait status');
       updateWaitStatus();
       console.log('Done');
-      setEmulatorStatus(`Ran ${count.toLocaleString()} cycles.`);
+      if (reason === STOP_REASON_HALTED) {
+        setEmulatorStatus("Program halted in a jump to itself.");
+      } else if (reason === STOP_REASON_WAITING && !api.isWaiting(instance)) {
+        setEmulatorStatus("Program is idle, waiting for serial input.");
+      } else {
+        setEmulatorStatus(`Ran ${count.toLocaleString()} cycles.`);
+      }
     }, 0);
   }
 
@@ -397,6 +519,8 @@ export function useEmulator() {
     const { api, instance } = context;
     api.step(instance);
     pullEmulatorOutput();
+    pullLcd();
+    pullDisplay();
     pullEmulatorState();
     updateWaitStatus();
     setEmulatorStatus("Stepped one instruction.");
@@ -417,7 +541,13 @@ export function useEmulator() {
     const newPtr = api.create();
     emulatorInstanceRef.current = newPtr;
     api.setOutputOptions(newPtr, 1, 0);
+    if (jitEnabled) {
+      api.setJitMode?.(newPtr, 1);
+    }
     api.clearOutput(newPtr);
+    lcdGenerationRef.current = -1;
+    lcdLinesRef.current = null;
+    displayGenerationRef.current = -1;
 
     setEmulatorLoaded(false);
     setEmulatorOutput("");
@@ -460,10 +590,20 @@ export function useEmulator() {
       module._free(ptr);
     }
 
+    // Hex keys are also held on the matrix keypad for 50 ms (50000 cycles)
+    // for programs that scan it themselves
+    const matrixKey = parseInt(value, 16);
+    if (api.keyEvent && value.length === 1 && !Number.isNaN(matrixKey)) {
+      api.keyEvent(instance, matrixKey, 1, 0);
+      api.keyEvent(instance, matrixKey, 0, 50000);
+    }
+
     // const autoCycles = Math.max(20, Math.floor(runCycles / 10));
     const autoCycles = 1000;
     api.runCycles(instance, autoCycles);
     pullEmulatorOutput();
+    pullLcd();
+    pullDisplay();
     pullEmulatorState();
     updateWaitStatus();
 
@@ -510,15 +650,20 @@ export function useEmulator() {
     emulatorLoaded,
     emulatorStatus,
     emulatorOutput,
+    lcdLines,
+    displayDigits,
     emulatorWaiting,
     emulatorState,
     registerBanks,
     runCycles,
+    jitAvailable: emulatorReady && !!emulatorApiRef.current?.setJitMode,
+    jitEnabled,
     emulatorHex,
     handleEmulatorHexChange,
     loadEmulatorHex,
     handleLoadProgram,
     handleRunCycleChange,
+    handleJitChange,
     handleRun,
     handleStep,
     handleResetEmulator,
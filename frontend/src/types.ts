@@ -63,13 +63,35 @@ export interface EmulatorApi {
   clearOutput: (ptr: number) => void;
   pushInput: (ptr: number, bufferPtr: number, length: number) => void;
   runCycles: (ptr: number, cycles: number) => void;
+  // Returns the stop reason; cycles run go to cyclesPtr unless it is 0
+  runUntil: (
+    ptr: number,
+    budget: number,
+    eventMask: number,
+    cyclesPtr: number
+  ) => number;
   step: (ptr: number) => void;
+  // Missing from emulator.wasm builds without the JIT exports
+  setJitMode?: (ptr: number, mode: number) => void;
   isWaiting: (ptr: number) => number;
   waitReason: (ptr: number) => number;
+  stopReason: (ptr: number) => number;
   getState: (ptr: number, statePtr: number) => void;
   stateSize: () => number;
   stateOffset: (field: number) => number;
   readByte: (ptr: number, offset: number) => number;
   readMemory: (ptr: number, offset: number) => number;
+  // Missing from emulator.wasm builds without the LCD model
+  lcdScreen?: (ptr: number) => number;
+  lcdGeneration?: (ptr: number) => number;
+  lcdTakeDirty?: (ptr: number) => number;
+  displayFrame?: (ptr: number) => number;
+  displayGeneration?: (ptr: number) => number;
+  keyEvent?: (
+    ptr: number,
+    key: number,
+    pressed: number,
+    delay: number
+  ) => void;
 }
 